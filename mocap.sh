@@ -3,15 +3,17 @@ printf "NOTE: Run this script as 'sudo ./[script_file].sh'\n\n"
 
 aruco_calibration_dict="14"
 aruco_detection_dict="14"  # "6"
+aruco_detection_ids=""  # e.g. "0-29". If non-empty, only these marker ids are decoded during detection.
 
 # ==============================================
 
 board_params="-w=5 -h=6 -l=100 -s=25 -d=$aruco_calibration_dict"
+# board_params="-charuco -w=5 -h=7 -l=75 -sq=100 -d=$aruco_calibration_dict"  # ChArUco board: subpixel chessboard corners, reaches a lower rethresh
 board_file="./config.d/calibration_board.png"
 
 calibration_reprojection_error="2.0"  # in pixels. ideally should e 1.0 or less
 calibration_detector_paramfile="./config.d/marker_detector_params_default.yml"
-calibration_params="-fmark=0.1 -frdiff=200 -nfcycle=25 -nfcalib=50 -rethresh=$calibration_reprojection_error"
+calibration_params="-fmark=0.1 -frdiff=200 -mingain=0.5 -nfcycle=25 -nfcalib=50 -rethresh=$calibration_reprojection_error"
 calibration_params_file="./config.d/intrinsic_params_video[ci].yml"
 
 # ----------------------------------------------
@@ -28,14 +30,26 @@ create_marker_params="-d=$aruco_detection_dict -ms=$marker_edgelen_pix"
 marker_file_prefix="./config.d/marker_"
 
 transformation_detector_paramfile="./config.d/marker_detector_params_default.yml"
-transformation_params="-d=$aruco_detection_dict -l=$marker_edgelen_m -fframe=0.75 -rmaxerr=1e-5 -tmaxerr=1e-8"
+transformation_params="-d=$aruco_detection_dict -l=$marker_edgelen_m -fframe=0.75 -rmaxerr=1e-11 -tmaxerr=1e-14"
 transformation_params_file="./config.d/transfomation_params_video[ci].yml"
 transformation_ground_coord_default="0:(0,0,0);4:(4,0,0);25:(0,5,0);29:(4,5,0);i"  # corners of 5x6 calibration board
+transformation_layout_file=""  # e.g. "./config.d/marker_layout.yml". If non-empty, the camera is located from the pose of this whole marker layout instead of ground coordinates.
 
 view_detector_paramfile="./config.d/marker_detector_params_default.yml"
 view_params="-d=$aruco_detection_dict"
 
 track_params="-d=$aruco_detection_dict -l=$marker_edgelen_m -mposeage=1.0"
+# track_params="$track_params -mask=./config.d/detection_mask_[ci].png"  # search only the non-zero pixels of a per-camera mask (image or .yml polygons)
+# track_params="$track_params -log=./poses.plog"  # binary pose log for analysis: ./bin/poselog ./poses.plog -o=poses.csv (or .npy)
+
+tune_params="-d=$aruco_detection_dict -nf=100 -minrecall=0.98 -maxcerr=0.5"
+tuned_detector_paramfile="./config.d/marker_detector_params_[ci].yml"  # use as view_detector_paramfile once tuned
+
+if [ "$aruco_detection_ids" != "" ]; then
+    view_params="$view_params -ids=$aruco_detection_ids"
+    track_params="$track_params -ids=$aruco_detection_ids"
+    tune_params="$tune_params -ids=$aruco_detection_ids"  # tune the detector trackmarkers runs with -ids
+fi
 
 # ==============================================
 
@@ -49,6 +63,8 @@ printf "Choose an action from below:
     (4) Calibrate camera.
     (5) Compute transformation.
     (6) Track markers.
+    --------------------------------
+    (7) Tune marker detector parameters.
 \n"
 read -p $'Press a number: ' -n 1 action
 printf "\n"
@@ -62,14 +78,10 @@ if [ $action -eq "1" ]; then
 
 # Create markers.
 elif [ $action -eq "2" ]; then
-    read -p $'Enter marker ID: ' markid
+    read -p $'Enter marker ID(s), e.g. 5 or 0-29,40: ' markid
     printf "\n"
-    (set -x ;
-    ./bin/createmarker $create_marker_params -id=$markid $marker_file_prefix$markid.png ;
-    convert \( -gravity center $marker_file_prefix$markid.png -background white -extent ${page_width}x${page_height} -density ${marker_dpi}x${marker_dpi} -units pixelsperinch \) \
-            \( -gravity northwest -pointsize 72 label:"$aruco_detection_dict:$markid" -geometry +50+50  \) \
-            -composite $marker_file_prefix$markid.pdf )
-    rm $marker_file_prefix$markid.png
+    set -x
+    ./bin/createmarker $create_marker_params -ids=$markid -pw=$page_width -ph=$page_height -dpi=$marker_dpi $marker_file_prefix$markid.pdf
     printf "Marker edge length in meters: $marker_edgelen_m \n"
 
 # View markers.
@@ -81,25 +93,30 @@ elif [ $action -eq "3" ]; then
 
 # Calibrate camera.
 elif [ $action -eq "4" ]; then
-    read -p $'Enter camera ID: ' -n 1 camid
+    read -p $'Enter camera IDs (comma-separated list with no space): ' camids
     printf "\n"
     set -x
-    ./bin/calibratecamera $board_params $calibration_params -ci=$camid -dp=$calibration_detector_paramfile $calibration_params_file
+    ./bin/calibratecamera $board_params $calibration_params -ci=$camids -dp=$calibration_detector_paramfile $calibration_params_file
 
 # Compute transformation.
 elif [ $action -eq "5" ]; then
     read -p $'Enter camera ID: ' -n 1 camid
     printf "\n"
-    read -p \
-      $"Marker ground coordinates [
-        Format: 'id1:(x1,y1,z1);id2:(x2,y2,z2);...;[i|u]'.
-        Default: $transformation_ground_coord_default  (corners of 5x6 calibration board) 
-      ]: " transformation_ground_coord
-    if [ "$transformation_ground_coord" == "" ]; then
-        transformation_ground_coord=$transformation_ground_coord_default
+    if [ "$transformation_layout_file" != "" ]; then
+        set -x
+        ./bin/computetransformation $transformation_params -ci=$camid -dp=$transformation_detector_paramfile -c=$calibration_params_file -layout=$transformation_layout_file  $transformation_params_file
+    else
+        read -p \
+          $"Marker ground coordinates [
+            Format: 'id1:(x1,y1,z1);id2:(x2,y2,z2);...;[i|u]'.
+            Default: $transformation_ground_coord_default  (corners of 5x6 calibration board) 
+          ]: " transformation_ground_coord
+        if [ "$transformation_ground_coord" == "" ]; then
+            transformation_ground_coord=$transformation_ground_coord_default
+        fi
+        set -x
+        ./bin/computetransformation $transformation_params -ci=$camid -dp=$transformation_detector_paramfile -c=$calibration_params_file -grcoords=$transformation_ground_coord  $transformation_params_file
     fi
-    set -x
-    ./bin/computetransformation $transformation_params -ci=$camid -dp=$transformation_detector_paramfile -c=$calibration_params_file -grcoords=$transformation_ground_coord  $transformation_params_file
 
 elif [ $action -eq "6" ]; then
     read -p $'Enter camera IDs (comma-separated list with no space): ' camids
@@ -107,5 +124,12 @@ elif [ $action -eq "6" ]; then
     set -x
     ./bin/trackmarkers $track_params -ci=$camids -dp=$view_detector_paramfile -c=$calibration_params_file -t=$transformation_params_file
 
+# Tune marker detector parameters.
+elif [ $action -eq "7" ]; then
+    read -p $'Enter camera IDs (comma-separated list with no space): ' camids
+    printf "\n"
+    set -x
+    ./bin/tuneparams $tune_params -ci=$camids -dp=$view_detector_paramfile $tuned_detector_paramfile
+
 fi
 
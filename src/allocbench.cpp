@@ -0,0 +1,168 @@
+/*
+By downloading, copying, installing or using the software you agree to this
+license. If you do not agree to this license, do not download, install,
+copy or use the software.
+
+                          License Agreement
+               For Open Source Computer Vision Library
+                       (3-clause BSD License)
+
+Copyright (C) 2013, OpenCV Foundation, all rights reserved.
+Third party copyrights are property of their respective owners.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  * Neither the names of the copyright holders nor the names of the contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+This software is provided by the copyright holders and contributors "as is" and
+any express or implied warranties, including, but not limited to, the implied
+warranties of merchantability and fitness for a particular purpose are
+disclaimed. In no event shall copyright holders or contributors be liable for
+any direct, indirect, incidental, special, exemplary, or consequential damages
+(including, but not limited to, procurement of substitute goods or services;
+loss of use, data, or profits; or business interruption) however caused
+and on any theory of liability, whether in contract, strict liability,
+or tort (including negligence or otherwise) arising in any way out of
+the use of this software, even if advised of the possibility of such damage.
+*/
+
+
+#define MOCAP_COUNT_ALLOCS    // always count: this is what the tool measures
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/aruco.hpp>
+#include <iostream>
+#include <vector>
+
+#include "utils/string_utils.hpp"
+#include "utils/marker_detector.hpp"
+#include "utils/frame_pool.hpp"
+#include "utils/alloc_counter.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+const char* about =
+        "Heap allocation benchmark of the per-frame loop of viewmarkers and trackmarkers.\n"
+        "  Runs the images through the FramePool with the same steps as that loop (copy in,\n"
+        "  detect, preview, draw; its own copy of them, not the tools' code) and counts, after a\n"
+        "  warm-up pass, the operator new calls of the buffer handling, detection and drawing,\n"
+        "  and the frame buffers that were reallocated. Only the buffer recycling is checked:\n"
+        "  it exits with 1 if the buffer handling allocated in the steady state. The detection\n"
+        "  and drawing counts are reported, not checked (OpenCV allocates inside both).\n";
+const char* keys  =
+        "{d        | 0     | dictionary: DICT_4X4_50=0, DICT_4X4_100=1, DICT_4X4_250=2,"
+        "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
+        "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
+        "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16}"
+        "{imgs     | scripts/*.png | Image glob pattern. The images are converted to gray and resized to the size of the first one }"
+        "{n        | 300   | Number of measured frames (the images are cycled) }"
+        "{ids      |       | Allowed marker ids, e.g. '0-29,40' (no space), for the built-in detector }"
+        "{fd       | false | Use the built-in single-pass marker detector (implied by -ids) }";
+}
+
+
+/**
+ */
+int main(int argc, char *argv[]) {
+    CommandLineParser parser(argc, argv, keys);
+    parser.about(about);
+
+    int dictionaryId = parser.get<int>("d");
+    int nFrames = parser.get<int>("n");
+    bool useMarkerDetector = parser.has("ids") || parser.get<bool>("fd");
+
+    if(!parser.check()) {
+        parser.printErrors();
+        return 0;
+    }
+
+    vector<String> imageFiles;
+    glob(parser.get<string>("imgs"), imageFiles);
+    vector<Mat> images;
+    for (int a=0; a<imageFiles.size(); ++a) {
+        Mat img = imread(imageFiles[a], IMREAD_GRAYSCALE);
+        if (img.empty()) continue;
+        if (!images.empty() && img.size() != images[0].size())
+            resize(img, img, images[0].size(), 0, 0, INTER_AREA);
+        images.push_back(img);
+    }
+    if (images.empty()) {
+        cerr << "No images found" << endl;
+        return 0;
+    }
+
+    aruco::Dictionary dictionary =
+        aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
+    aruco::DetectorParameters detectorParams;
+    detectorParams.doCornerRefinement = true;
+    MarkerDetector markerDetector;
+    if (useMarkerDetector)
+        markerDetector = MarkerDetector(dictionary, detectorParams, parse_id_list(parser.get<string>("ids")));
+
+    FramePool framePool;
+    int warmup = 2 * (int)images.size();
+    long bufferAllocs = 0, detectAllocs = 0, drawAllocs = 0, framesWithBufferAllocs = 0, movedBuffers = 0;
+    const uchar *imageData = 0, *previewData = 0;
+
+    for (int it=0; it<warmup+nFrames; ++it) {
+        bool measured = it >= warmup;
+        const Mat& input = images[it % images.size()];
+
+        // same steps as the capture -> detect -> draw loop of viewmarkers
+        long count0 = allocation_count();
+        FrameSlot& frame = framePool.acquire();
+        input.copyTo(frame.image);
+        frame.det.clear();
+        long count1 = allocation_count();
+        if (useMarkerDetector)
+            markerDetector.detect(frame.image, frame.det);
+        else
+            aruco::detectMarkers(frame.image, dictionary, frame.det.corners, frame.det.ids, detectorParams, frame.det.rejected);
+        long count2 = allocation_count();
+        cvtColor(frame.image, frame.preview, COLOR_GRAY2BGR);
+        long count3 = allocation_count();
+        if (frame.det.ids.size() > 0)
+            aruco::drawDetectedMarkers(frame.preview, frame.det.corners, frame.det.ids);
+        long count4 = allocation_count();
+        framePool.release(frame);
+        long count5 = allocation_count();
+
+        if (!measured) {
+            imageData = frame.image.data;
+            previewData = frame.preview.data;
+            continue;
+        }
+        // cv::Mat data comes from cv::fastMalloc, which the counter does not see: check the buffers stayed put
+        if (frame.image.data != imageData) ++movedBuffers;
+        if (frame.preview.data != previewData) ++movedBuffers;
+        imageData = frame.image.data;
+        previewData = frame.preview.data;
+
+        long buffers = (count1 - count0) + (count3 - count2) + (count5 - count4);
+        bufferAllocs += buffers;
+        if (buffers > 0) ++framesWithBufferAllocs;
+        detectAllocs += count2 - count1;
+        drawAllocs += count4 - count3;
+    }
+
+    cout << nFrames << " frames of " << images[0].cols << "x" << images[0].rows << " from " << images.size() << " images, "
+         << (useMarkerDetector ? "built-in detector" : "aruco::detectMarkers") << endl;
+    cout << "Heap allocations per frame: buffers " << (double)bufferAllocs / nFrames
+         << ", detection " << (double)detectAllocs / nFrames << ", drawing " << (double)drawAllocs / nFrames << endl;
+    cout << "Frames with buffer allocations: " << framesWithBufferAllocs << ". Reallocated frame buffers: " << movedBuffers << endl;
+
+    return (framesWithBufferAllocs > 0 || movedBuffers > 0 ? 1 : 0);
+}
@@ -40,14 +40,19 @@ the use of this software, even if advised of the possibility of such damage.
 #include <opencv2/highgui.hpp>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/aruco.hpp>
+#include <opencv2/aruco/charuco.hpp>
 #include <opencv2/imgproc.hpp>
 #include <vector>
 #include <iostream>
 #include <ctime>
 #include <limits>
 #include <unordered_map>
+#include <thread>
+#include <atomic>
 
 #include "utils/string_utils.hpp"
+#include "utils/calib_frame_selector.hpp"
+#include "utils/thread_pool.hpp"
 
 //socket libraries
 /*#include<sys/types.h> 
@@ -65,22 +70,28 @@ using namespace cv;
 
 namespace {
 const char* about =
-        "Calibration using a ArUco Planar Grid board\n"
+        "Calibration using a ArUco Planar Grid board (or a ChArUco board, with -charuco)\n"
         "  To capture a frame for calibration, press 'c',\n"
         "  If input comes from video, press any key for next frame\n"
-        "  To finish capturing, press 'ESC' key and calibration starts.\n";
+        "  To finish capturing, press 'ESC' key and calibration starts.\n"
+        "  With -offline all frames of a video or image set are used, without display.\n";
 const char* keys  =
         "{w        |       | Number of squares in X direction }"
         "{h        |       | Number of squares in Y direction }"
         "{l        |       | Marker side lenght (in meters) }"
         "{s        |       | Separation between two consecutive markers in the grid (in meters) }"
+        "{charuco  | false | Calibrate with a ChArUco board of -w x -h chessboard squares, using the interpolated chessboard corners }"
+        "{sq       |       | Chessboard square side length of a ChArUco board (in meters) }"
         "{d        |       | dictionary: DICT_4X4_50=0, DICT_4X4_100=1, DICT_4X4_250=2,"
         "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
         "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
         "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16}"
         "{@outfile |<none> | Output file with calibrated camera parameters }"
         "{v        |       | Input from video file, if ommited, input comes from camera }"
-        "{ci       | 0     | Camera id if input doesnt come from video (-v) }"
+        "{ci       | 0     | Camera id(s) if input doesnt come from video (-v), comma separated e.g. 0,1,2 }"
+        "{offline  | false | Calibrate without display from all frames of -v or -imgs, detecting on a thread pool }"
+        "{imgs     |       | Input images for -offline (directory or glob pattern, e.g. frames/*.png) }"
+        "{nthreads | 0     | Number of detection threads for -offline (0: one per core) }"
         "{waittime | 50   | Inter-frame wait time (in ms). }"
         "{dp       |       | File of marker detector parameters }"
         "{rs       | false | Apply refind strategy }"
@@ -89,6 +100,7 @@ const char* keys  =
         "{pc       | false | Fix the principal point at the center }"
         "{fmark    | 0.4   | Fraction of markers to be observed in order to capture a frame }"
         "{frdiff   | 200   | Acceptable average distance between markers between consecutive captured frames}"
+        "{mingain  | 0.5   | Min. information gain (image coverage + board pose novelty, 0-2) for a frame to be captured }"
         "{nfcycle  | 10    | Number of frames to capture before attempting a callibration }"
         "{nfcalib  | 30    | Max. number of frames to use during a calibration}"
         "{rethresh | 1.0   | Acceptable re-projection error threshold }";
@@ -172,14 +184,7 @@ static bool saveCameraParams(const string &filename, Size imageSize, float aspec
 
 // =================================================
 
-template <class T>
-int find_in_vec (T val, vector<T> vec) {
-    for (int a=0; a<vec.size(); ++a)
-        if (vec[a] == val)  return (a);
-    return (-1);
-}
-
-double marker_dist (std::vector<cv::Point2f> corner1, std::vector<cv::Point2f> corner2) {
+double marker_dist (const std::vector<cv::Point2f>& corner1, const std::vector<cv::Point2f>& corner2) {
     return (norm ( (corner1[0]+corner1[1]+corner1[2]+corner1[3]) - (corner2[0]+corner2[1]+corner2[2]+corner2[3]) ) );
 }
 
@@ -188,56 +193,383 @@ double marker_dist (std::vector<cv::Point2f> corner1, std::vector<cv::Point2f> c
 int nFramesPerCalibration, calibrationFlags = 0;
 float aspectRatio = 1;
 aruco::GridBoard board;
-string outputFile;
+aruco::CharucoBoard charucoBoard;
+bool useCharuco = false;
 
-// collected frames for calibration
-vector< vector< vector< Point2f > > > allCorners;
-vector< vector< int > > allIds;
-Size imgSize;
+// board whose markers are detected: the grid board, or the markers of the ChArUco board
+aruco::Board& marker_board () {
+    if (useCharuco) return (charucoBoard);
+    return (board);
+}
+
+// Markers of the board found in one image and, for a ChArUco board, the chessboard corners
+// interpolated between them.
+struct BoardDetection {
+    vector< int > ids;
+    vector< vector< Point2f > > corners;
+    vector< Point2f > charucoCorners;
+    vector< int > charucoIds;
+
+    void clear () {
+        ids.clear();
+        corners.clear();
+        charucoCorners.clear();
+        charucoIds.clear();
+    }
+};
+
+void detect_board (const Mat& image, const aruco::Dictionary& dictionary, const aruco::DetectorParameters& detectorParams,
+                   bool refindStrategy, BoardDetection& det) {
+    vector< vector< Point2f > > rejected;
+    det.clear();
+
+    // detect markers
+    aruco::detectMarkers(image, dictionary, det.corners, det.ids, detectorParams, rejected);
+
+    // refind strategy to detect more markers
+    if(refindStrategy) aruco::refineDetectedMarkers(image, marker_board(), det.corners, det.ids, rejected);
+
+    if(useCharuco && det.ids.size() > 0)
+        aruco::interpolateCornersCharuco(det.corners, det.ids, image, charucoBoard, det.charucoCorners, det.charucoIds);
+}
 
 // =================================================
 
-bool attempt_calibration (double repErrorThresh=std::numeric_limits<double>::max()) {
+// Snapshot of the captured frames used by one calibration attempt.
+struct CalibrationFrames {
     vector< vector< Point2f > > allCornersConcatenated;
     vector< int > allIdsConcatenated;
     vector< int > markerCounterPerFrame;
-    
+    vector< vector< Point2f > > charucoCorners;  // ChArUco board: chessboard corners of each frame
+    vector< vector< int > > charucoIds;
+    vector< int > frameIdx;                 // index of each frame in allCorners
+    Size imgSize;
+    Mat cameraMatrixGuess, distCoeffsGuess; // empty for a cold start
+};
+
+struct CalibrationResult {
     Mat cameraMatrix, distCoeffs;
     vector< Mat > rvecs, tvecs;
+    vector< int > frameIdx;
     double repError;
+    int nFrames;
+    bool warmStarted;
+};
+
+CalibrationResult run_calibration (const CalibrationFrames& frames) {
+    CalibrationResult result;
+    int flags = calibrationFlags;
+
+    result.warmStarted = !frames.cameraMatrixGuess.empty();
+    if (result.warmStarted) {
+        // start from the previous intrinsics: the solver then only has to correct them
+        frames.cameraMatrixGuess.copyTo (result.cameraMatrix);
+        frames.distCoeffsGuess.copyTo (result.distCoeffs);
+        flags |= CALIB_USE_INTRINSIC_GUESS;
+    }
+    else if(calibrationFlags & CALIB_FIX_ASPECT_RATIO) {
+        result.cameraMatrix = Mat::eye(3, 3, CV_64F);
+        result.cameraMatrix.at< double >(0, 0) = aspectRatio;
+    }
 
-    if(calibrationFlags & CALIB_FIX_ASPECT_RATIO) {
-        cameraMatrix = Mat::eye(3, 3, CV_64F);
-        cameraMatrix.at< double >(0, 0) = aspectRatio;
+    // calibrate camera
+    if (useCharuco)
+        result.repError = aruco::calibrateCameraCharuco(frames.charucoCorners, frames.charucoIds, charucoBoard,
+                                                        frames.imgSize, result.cameraMatrix, result.distCoeffs,
+                                                        result.rvecs, result.tvecs, flags);
+    else
+        result.repError = aruco::calibrateCameraAruco(frames.allCornersConcatenated, frames.allIdsConcatenated,
+                                                      frames.markerCounterPerFrame, board, frames.imgSize, result.cameraMatrix,
+                                                      result.distCoeffs, result.rvecs, result.tvecs, flags);
+    result.frameIdx = frames.frameIdx;
+    result.nFrames = (int)frames.markerCounterPerFrame.size();
+    return (result);
+}
+
+// -------------------------------------------------
+
+/**
+ * Runs calibrations on a background thread, so that capture and preview go on during a solve.
+ */
+class CalibrationWorker {
+public:
+    CalibrationWorker () : running(false), finished(false) { }
+    ~CalibrationWorker () { if (worker.joinable()) worker.join(); }
+
+    // Also true while a finished result has not been collected with poll().
+    bool busy () const { return (running || finished); }
+
+    void start (const CalibrationFrames& frames) {
+        if (worker.joinable()) worker.join();
+        running = true;
+        finished = false;
+        worker = std::thread ([this, frames] () {
+            result = run_calibration (frames);
+            finished = true;
+            running = false;
+        });
+    }
+
+    // Returns true (once) when a started calibration has finished.
+    bool poll (CalibrationResult& res) {
+        if (!finished) return (false);
+        collect (res);
+        return (true);
+    }
+
+    // Blocks until a started calibration has finished; false if none was started.
+    bool wait (CalibrationResult& res) {
+        if (!running && !finished) return (false);
+        collect (res);
+        return (true);
+    }
+
+private:
+    std::thread worker;
+    std::atomic<bool> running, finished;
+    CalibrationResult result;
+
+    // Joins the worker (once) and hands over its result.
+    void collect (CalibrationResult& res) {
+        if (worker.joinable()) worker.join();
+        finished = false;
+        res = result;
     }
+};
+
+// -------------------------------------------------
 
-    // concatinate data for calibration
-    for(unsigned int i = _max(0,((int)allCorners.size())-nFramesPerCalibration); i < allCorners.size(); ++i) {
-        markerCounterPerFrame.push_back ((int)allCorners[i].size());
-        for(unsigned int j = 0; j < allCorners[i].size(); j++) {
-            allCornersConcatenated.push_back(allCorners[i][j]);
-            allIdsConcatenated.push_back(allIds[i][j]);
+/**
+ * Calibration state of one camera: its input, the collected frames, the latest calibration
+ * so far and the worker solving it.
+ */
+struct CameraSession {
+    int camId;
+    string outputFile;
+    aruco::DetectorParameters detectorParams;
+    VideoCapture inputVideo;
+
+    // collected frames for calibration
+    vector< vector< vector< Point2f > > > allCorners;
+    vector< vector< int > > allIds;
+    vector< vector< Point2f > > allCharucoCorners;   // ChArUco board only
+    vector< vector< int > > allCharucoIds;
+    Size imgSize;
+    CalibFrameSelector selector;        // coverage index of the collected frames
+    unordered_map<int,int> lastFramePos;   // marker id -> position in the last captured frame
+
+    // latest calibration, used as the initial guess of the next solve
+    Mat latestCameraMatrix, latestDistCoeffs;
+
+    CalibrationWorker worker;
+    bool cyclePending;   // a cycle of new frames arrived while the worker was busy
+    bool done;           // calibration saved
+
+    // frame of the current iteration
+    Mat image;
+    BoardDetection det;
+    bool grabbed;
+
+    CameraSession (int id) : camId(id), cyclePending(false), done(false), grabbed(false) { }
+};
+
+// =================================================
+
+CalibrationFrames collect_calibration_frames (const CameraSession& cam) {
+    CalibrationFrames frames;
+    // concatinate data of the most informative frames for calibration
+    vector< int > selected = cam.selector.select (nFramesPerCalibration);
+    for(unsigned int k = 0; k < selected.size(); ++k) {
+        int i = selected[k];
+        frames.markerCounterPerFrame.push_back ((int)cam.allCorners[i].size());
+        frames.frameIdx.push_back (i);
+        for(unsigned int j = 0; j < cam.allCorners[i].size(); j++) {
+            frames.allCornersConcatenated.push_back(cam.allCorners[i][j]);
+            frames.allIdsConcatenated.push_back(cam.allIds[i][j]);
+        }
+        if (useCharuco) {
+            frames.charucoCorners.push_back(cam.allCharucoCorners[i]);
+            frames.charucoIds.push_back(cam.allCharucoIds[i]);
         }
     }
-    cout << "exiting loop" << endl;
-    
-    // calibrate camera
-    repError = aruco::calibrateCameraAruco(allCornersConcatenated, allIdsConcatenated,
-                                           markerCounterPerFrame, board, imgSize, cameraMatrix,
-                                           distCoeffs, rvecs, tvecs, calibrationFlags);
-    
-    if (repError < repErrorThresh) {
-        bool savedOk = saveCameraParams (outputFile, imgSize, aspectRatio, calibrationFlags, cameraMatrix, distCoeffs, repError);
-        if (!savedOk) cout << "Failed to save file." <<endl;
-        cout << "Reprojection error = " << repError << ". Camera params saved in " << outputFile << endl;
+    frames.imgSize = cam.imgSize;
+    if (!cam.latestCameraMatrix.empty()) {
+        frames.cameraMatrixGuess = cam.latestCameraMatrix.clone();
+        frames.distCoeffsGuess = cam.latestDistCoeffs.clone();
+    }
+    return (frames);
+}
+
+// Board pose from the latest intrinsics, or from a pinhole guess (f = image width) before the first calibration.
+bool estimate_board_pose (const CameraSession& cam, const vector< vector< Point2f > >& corners, const vector< int >& ids,
+                          Size imageSize, Mat& rvec, Mat& tvec) {
+    Mat cameraMatrix = cam.latestCameraMatrix, distCoeffs = cam.latestDistCoeffs;
+    if (cameraMatrix.empty()) {
+        cameraMatrix = (Mat_<double>(3,3) << imageSize.width, 0, imageSize.width/2.0,
+                                             0, imageSize.width, imageSize.height/2.0,
+                                             0, 0, 1);
+        distCoeffs = Mat::zeros (1, 5, CV_64F);
+    }
+    return (aruco::estimatePoseBoard (corners, ids, marker_board(), cameraMatrix, distCoeffs, rvec, tvec) > 0);
+}
+
+// Re-bins the frames with the board poses of a finished solve and keeps its intrinsics. Each solve
+// uses a different frame selection, so their reprojection errors are not compared: the latest one,
+// which saw the most frames and started from the previous intrinsics, is kept.
+void update_calibration_cache (CameraSession& cam, const CalibrationResult& result) {
+    for (int a=0; a<result.frameIdx.size(); ++a) {
+        cam.selector.set_pose_bin (result.frameIdx[a], cam.selector.pose_bin (result.rvecs[a], result.tvecs[a]));
+    }
+    cam.latestCameraMatrix = result.cameraMatrix;
+    cam.latestDistCoeffs = result.distCoeffs;
+}
+
+bool accept_calibration (const CameraSession& cam, const CalibrationResult& result, double repErrorThresh=std::numeric_limits<double>::max()) {
+    if (result.repError < repErrorThresh) {
+        bool savedOk = saveCameraParams (cam.outputFile, cam.imgSize, aspectRatio, calibrationFlags, result.cameraMatrix, result.distCoeffs, result.repError);
+        if (!savedOk) cout << "[cam " << cam.camId << "] Failed to save file." <<endl;
+        cout << "[cam " << cam.camId << "] Reprojection error = " << result.repError << ". Camera params saved in " << cam.outputFile << endl;
         return (savedOk);
     }
     else {
-        cout << "repError = " << repError << ". Error threshold not met." << endl;
+        cout << "[cam " << cam.camId << "] repError = " << result.repError << " (" << result.nFrames << " frames, "
+             << (result.warmStarted ? "warm" : "cold") << " start). Error threshold not met." << endl;
         return (false);
     }
 }
 
+// -------------------------------------------------
+
+// frame acceptance settings
+double minMarkerFraction, frameDiffThresh, minInfoGain;
+int nBoardMarkers;
+
+// Adds the detections of a frame to the calibration set if the frame has enough markers, differs
+// enough from the last captured frame and adds image coverage or a new board pose.
+bool capture_frame (CameraSession& cam, const BoardDetection& det, Size imageSize) {
+    const vector< int >& ids = det.ids;
+    const vector< vector< Point2f > >& corners = det.corners;
+    if ( ids.size() <= (int)(minMarkerFraction*nBoardMarkers) ) {  // SB
+        cout << "[cam " << cam.camId << "] Frame has insufficient markers: " << ids.size() << endl;
+        return (false);
+    }
+    if ( useCharuco && det.charucoIds.size() < 4 ) {
+        cout << "[cam " << cam.camId << "] Frame has insufficient chessboard corners: " << det.charucoIds.size() << endl;
+        return (false);
+    }
+
+    // test if the frame is significantly different from last captured frame
+    double avg_marker_dist = std::numeric_limits<double>::max();
+    if (cam.allIds.size() > 0) {
+        int match_ct = 0;
+        double total_dist = 0.0;
+        for (int a=0; a<ids.size(); ++a) {
+            auto lastpos = cam.lastFramePos.find (ids[a]); // find the id in the last reading
+            if (lastpos != cam.lastFramePos.end()) { // found the id in the last frame
+                total_dist += marker_dist (corners[a], cam.allCorners.back()[lastpos->second]);
+                ++match_ct;
+            }
+        }
+        avg_marker_dist = total_dist/match_ct;
+        if (match_ct!=0 && avg_marker_dist<frameDiffThresh) {
+            cout << "[cam " << cam.camId << "] Frame is not sufficiently different from last: " << avg_marker_dist << endl;
+            return (false);
+        }
+    }
+
+    // test if the frame adds image coverage or a new board pose
+    if (cam.selector.empty()) cam.selector.init (imageSize);
+    Mat rvec, tvec;
+    int poseBin = -1;
+    if (estimate_board_pose (cam, corners, ids, imageSize, rvec, tvec))
+        poseBin = cam.selector.pose_bin (rvec, tvec);
+    double infoGain = cam.selector.information_gain (corners, poseBin);
+    if (infoGain < minInfoGain) {
+        cout << "[cam " << cam.camId << "] Frame adds too little coverage: " << infoGain << endl;
+        return (false);
+    }
+
+    cout << "[cam " << cam.camId << "] Frame captured (gain " << infoGain << ")" << endl;
+    cam.allCorners.push_back(corners);
+    cam.allIds.push_back(ids);
+    if (useCharuco) {
+        cam.allCharucoCorners.push_back(det.charucoCorners);
+        cam.allCharucoIds.push_back(det.charucoIds);
+    }
+    cam.selector.add_frame (corners, poseBin);
+    if (poseBin >= 0 && !cam.selector.has_reference_distance())   // the first frame's pose was binned as the reference
+        cam.selector.set_reference_distance (norm (tvec));
+    cam.imgSize = imageSize;
+    cam.lastFramePos.clear();
+    for (int a=0; a<ids.size(); ++a)
+        cam.lastFramePos[ids[a]] = a;
+    return (true);
+}
+
+// -------------------------------------------------
+
+/**
+ * Non-interactive calibration: frames of the video (or the images) are read in batches and the
+ * board is detected on all frames of a batch in parallel. Frame selection then runs in frame
+ * order as in the interactive mode, and a single calibration is solved at the end.
+ */
+int calibrate_offline (CameraSession& cam, const String& video, const vector< String >& imageFiles,
+                       const aruco::Dictionary& dictionary, bool refindStrategy, int nThreads, double repErrorThresh) {
+    struct FrameDetection {
+        Mat image;
+        BoardDetection det;
+    };
+
+    if (!video.empty()) {
+        cam.inputVideo.open(video);
+        if (!cam.inputVideo.isOpened()) {
+            cerr << "Could not open " << video << endl;
+            return (1);
+        }
+    }
+
+    ThreadPool pool (nThreads);
+    vector< FrameDetection > batch (8*pool.size());
+    int nRead = 0;
+    while (true) {
+        // decoding a video is sequential; images are read by the workers
+        int n = 0;
+        if (!video.empty())
+            while (n < batch.size() && cam.inputVideo.read(batch[n].image)) ++n;
+        else
+            n = std::min ((int)batch.size(), (int)imageFiles.size()-nRead);
+        if (n == 0) break;
+
+        pool.parallel_for (n, [&] (int i) {
+            FrameDetection& frame = batch[i];
+            if (video.empty()) frame.image = imread (imageFiles[nRead+i], IMREAD_GRAYSCALE);
+            frame.det.clear();
+            if (frame.image.empty()) return;
+            detect_board (frame.image, dictionary, cam.detectorParams, refindStrategy, frame.det);
+        });
+
+        for (int i=0; i<n; ++i) {
+            if (batch[i].image.empty()) {
+                cout << "Could not read " << imageFiles[nRead+i] << endl;
+                continue;
+            }
+            capture_frame (cam, batch[i].det, batch[i].image.size());
+        }
+        nRead += n;
+    }
+
+    cout << nRead << " frames read, " << cam.allIds.size() << " captured. Calibrating with "
+         << std::min((int)cam.allIds.size(),nFramesPerCalibration) << " selected frames on " << pool.size() << " threads." << endl;
+    if (cam.allIds.empty()) {
+        cerr << "No usable frames." << endl;
+        return (1);
+    }
+    CalibrationResult result = run_calibration (collect_calibration_frames (cam));
+    update_calibration_cache (cam, result);
+    return (accept_calibration (cam, result, repErrorThresh) ? 0 : 1);
+}
+
+// =================================================
  
 int main(int argc, char *argv[]) {
     CommandLineParser parser(argc, argv, keys);
@@ -248,15 +580,16 @@ int main(int argc, char *argv[]) {
         return 0;
     }
     
-    int camId = parser.get<int>("ci");
-    unordered_map<string,string> fname_replacements = { {"[ci]", to_string(camId)} };
+    vector<int> camIds = parse_id_list (parser.get<string>("ci"));
 
     int markersX = parser.get<int>("w");
-    int markersY = parser.get<int>("w");
+    int markersY = parser.get<int>("h");
     float markerLength = parser.get<float>("l");
-    float markerSeparation = parser.get<float>("s");
+    useCharuco = parser.get<bool>("charuco");
+    float markerSeparation = 0, squareLength = 0;
+    if(useCharuco) squareLength = parser.get<float>("sq");
+    else markerSeparation = parser.get<float>("s");
     int dictionaryId = parser.get<int>("d");
-    outputFile = multi_replace(parser.get<String>(0),fname_replacements);
     
     if(parser.has("a")) {
         calibrationFlags |= CALIB_FIX_ASPECT_RATIO;
@@ -265,22 +598,32 @@ int main(int argc, char *argv[]) {
     if(parser.get<bool>("zt")) calibrationFlags |= CALIB_ZERO_TANGENT_DIST;
     if(parser.get<bool>("pc")) calibrationFlags |= CALIB_FIX_PRINCIPAL_POINT;
 
-    aruco::DetectorParameters detectorParams;
-    if(parser.has("dp")) {
-        bool readOk = readDetectorParameters (multi_replace(parser.get<string>("dp"),fname_replacements), detectorParams);
-        if(!readOk) {
-            cerr << "Invalid detector parameters file" << endl;
-            return 0;
+    // per-camera sessions, with [ci] in file names replaced by the camera id
+    unordered_map<int,Ptr<CameraSession>> sessions;
+    for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+        unordered_map<string,string> fname_replacements = { {"[ci]", to_string(*it)} };
+        Ptr<CameraSession> cam = makePtr<CameraSession>(*it);
+        cam->outputFile = multi_replace(parser.get<String>(0),fname_replacements);
+        if(parser.has("dp")) {
+            bool readOk = readDetectorParameters (multi_replace(parser.get<string>("dp"),fname_replacements), cam->detectorParams);
+            if(!readOk) {
+                cerr << "Invalid detector parameters file" << endl;
+                return 0;
+            }
         }
+        sessions[*it] = cam;
     }
 
     bool refindStrategy = parser.get<bool>("rs");
     
-    double frac_marker = parser.get<double>("fmark");
+    minMarkerFraction = parser.get<double>("fmark");
     int nFramesPerCycle = parser.get<int>("nfcycle");
     nFramesPerCalibration = parser.get<int>("nfcalib");
     double repErrorThresh = parser.get<double>("rethresh");
-    double frameDiffThresh = parser.get<double>("frdiff");
+    frameDiffThresh = parser.get<double>("frdiff");
+    minInfoGain = parser.get<double>("mingain");
+    bool offline = parser.get<bool>("offline");
+    int nThreads = parser.get<int>("nthreads");
     
     
     String video;
@@ -288,6 +631,22 @@ int main(int argc, char *argv[]) {
     if(parser.has("v")) {
         video = parser.get<String>("v");
     }
+    vector< String > imageFiles;
+    if(parser.has("imgs")) {
+        glob(parser.get<String>("imgs"), imageFiles);
+        if(imageFiles.empty()) {
+            cerr << "No images found in " << parser.get<String>("imgs") << endl;
+            return 1;
+        }
+    }
+    if(offline && video.empty() && imageFiles.empty()) {
+        cerr << "-offline needs a video (-v) or images (-imgs)" << endl;
+        return 1;
+    }
+    if((!video.empty() || !imageFiles.empty()) && camIds.size() != 1) {
+        cerr << "A video or image input is for a single camera: give one id with -ci" << endl;
+        return 1;
+    }
 
     if(!parser.check()) {
         parser.printErrors();
@@ -295,88 +654,127 @@ int main(int argc, char *argv[]) {
     }
     
 
-    VideoCapture inputVideo;
-    int waitTime;
-    if(!video.empty()) {
-        inputVideo.open(video);
-        waitTime = 0;
-    } else {
-        inputVideo.open(camId);
-        waitTime = parser.get<int>("waittime");
-    }
-
     aruco::Dictionary dictionary =
         aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
 
     // create board object
-    board = aruco::GridBoard::create(markersX, markersY, markerLength, markerSeparation, dictionary);
-
-    while(inputVideo.grab()) {
-        Mat image, imageCopy;
-        inputVideo.retrieve(image);
+    if(useCharuco)
+        charucoBoard = aruco::CharucoBoard::create(markersX, markersY, squareLength, markerLength, dictionary);
+    else
+        board = aruco::GridBoard::create(markersX, markersY, markerLength, markerSeparation, dictionary);
+    nBoardMarkers = (int)marker_board().ids.size();
 
-        vector< int > ids;
-        vector< vector< Point2f > > corners, rejected;
+    if(offline)
+        return (calibrate_offline (*sessions[camIds[0]], video, imageFiles, dictionary, refindStrategy, nThreads, repErrorThresh));
 
-        // detect markers
-        aruco::detectMarkers(image, dictionary, corners, ids, detectorParams, rejected);
+    int waitTime;
+    if(!video.empty()) {
+        sessions[camIds[0]]->inputVideo.open(video);
+        waitTime = 0;
+    } else {
+        for (auto it=camIds.begin(); it!=camIds.end(); ++it)
+            sessions[*it]->inputVideo.open(*it);
+        waitTime = parser.get<int>("waittime");
+    }
 
-        // refind strategy to detect more markers
-        if(refindStrategy) aruco::refineDetectedMarkers(image, board, corners, ids, rejected);
+    // detection runs on all cameras in parallel, solves run on each camera's own worker
+    ThreadPool pool ((int)camIds.size());
+    int nRemaining = (int)camIds.size();
+    CalibrationResult result;
+
+    while(nRemaining > 0) {
+        // grab from all cameras first, so that their frames are as close in time as possible
+        int nGrabbed = 0;
+        for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+            CameraSession& cam = *sessions[*it];
+            cam.grabbed = !cam.done && cam.inputVideo.grab();
+            if (cam.grabbed) ++nGrabbed;
+        }
+        if (nGrabbed == 0) break;
+
+        for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+            CameraSession& cam = *sessions[*it];
+            if (cam.done) continue;
+            // swap in the newest calibration as soon as it finishes
+            if (cam.worker.poll (result)) {
+                update_calibration_cache (cam, result);
+                if (accept_calibration (cam, result, repErrorThresh)) { // successful
+                    cout << "[cam " << cam.camId << "] Successful!!" << endl;
+                    cam.done = true;
+                    --nRemaining;
+                    continue;
+                }
+                cout << "[cam " << cam.camId << "] Continuing to gather frames." << endl;
+            }
+            if (cam.cyclePending && !cam.worker.busy()) {
+                cout << "[cam " << cam.camId << "] Restarting calibration with " << std::min((int)cam.allIds.size(),nFramesPerCalibration) << " selected frames." << endl;
+                cam.worker.start (collect_calibration_frames (cam));
+                cam.cyclePending = false;
+            }
+        }
 
-        // draw results
-        image.copyTo(imageCopy);
-        if(ids.size() > 0) aruco::drawDetectedMarkers(imageCopy, corners, ids);
-        putText(imageCopy, "Show calibration board to camera.",
-                Point(10, 20), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 0, 0), 2);
+        pool.parallel_for ((int)camIds.size(), [&] (int c) {
+            CameraSession& cam = *sessions[camIds[c]];
+            cam.det.clear();
+            if (cam.done || !cam.grabbed) return;
+            cam.inputVideo.retrieve(cam.image);
+            detect_board (cam.image, dictionary, cam.detectorParams, refindStrategy, cam.det);
+        });
+
+        for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+            CameraSession& cam = *sessions[*it];
+            if (cam.done || !cam.grabbed) continue;
+
+            // draw results
+            Mat imageCopy;
+            cam.image.copyTo(imageCopy);
+            if(cam.det.ids.size() > 0) aruco::drawDetectedMarkers(imageCopy, cam.det.corners, cam.det.ids);
+            if(cam.det.charucoIds.size() > 0) aruco::drawDetectedCornersCharuco(imageCopy, cam.det.charucoCorners, cam.det.charucoIds);
+            putText(imageCopy, "Show calibration board to camera.",
+                    Point(10, 20), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 0, 0), 2);
+            imshow("out " + to_string(cam.camId), imageCopy); // SB
+
+            if (capture_frame (cam, cam.det, cam.image.size())) {
+                if (cam.allIds.size() % nFramesPerCycle == 0) {
+                    //break;
+                    if (cam.worker.busy()) {
+                        cout << "[cam " << cam.camId << "] " << nFramesPerCycle << " new frames have been captured. Will recalibrate when the running calibration ends." << endl;
+                        cam.cyclePending = true;
+                    }
+                    else {
+                        cout << "[cam " << cam.camId << "] " << nFramesPerCycle << " new frames have been captured. Will now (re)attempt calibration in the background." << endl;
+                        cam.worker.start (collect_calibration_frames (cam));
+                    }
+                }
+            }
+        }
 
-        imshow("out", imageCopy); // SB
         char key = (char) waitKey (waitTime); // SB
         // if(key == 27) break; // SB
-        
-        if ( ids.size() > (int)(frac_marker*((double)markersX*markersY)) ) {  // SB
-            
-            // test if the frame is significantly different from last captured frame
-            double avg_marker_dist = std::numeric_limits<double>::max();
-            if (allIds.size() > 0) {
-                int match_ct = 0;
-                double total_dist = 0.0;
-                for (int a=0; a<ids.size(); ++a) {
-                    int lastpos = find_in_vec (ids[a], allIds.back()); // find the id in the last reading
-                    if (lastpos >= 0) { // found the id in the last frame
-                        total_dist += marker_dist (corners[a], allCorners.back()[lastpos]);
-                        ++match_ct;
-                    }
-                }
-                avg_marker_dist = total_dist/match_ct;
-                if (match_ct!=0 && avg_marker_dist<frameDiffThresh) {
-                    cout << "Frame is not sufficiently different from last: " << avg_marker_dist << endl;
-                    continue;
-                }
+    }
+
+    if (nRemaining == 0)
+        return (0);
+
+    // let the last calibrations finish, and solve the cycles still waiting for one, before giving up
+    for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+        CameraSession& cam = *sessions[*it];
+        while (!cam.done) {
+            if (cam.cyclePending && !cam.worker.busy()) {
+                cout << "[cam " << cam.camId << "] Restarting calibration with " << std::min((int)cam.allIds.size(),nFramesPerCalibration) << " selected frames." << endl;
+                cam.worker.start (collect_calibration_frames (cam));
+                cam.cyclePending = false;
             }
-            
-            cout << "Frame captured" << endl;
-            allCorners.push_back(corners);
-            allIds.push_back(ids);
-            imgSize = image.size();
-            
-            if (allIds.size() % nFramesPerCycle == 0) {
-                //break;
-                cout << nFramesPerCycle << " new frames have been captured. Will now (re)attempt calibration." << endl;
-                if (attempt_calibration (repErrorThresh)) { // successful
-                    cout << "Successful!!" << endl;
-                    return(0);
-                }
-                else
-                    cout << "Continuing to gather frames." << endl;
+            if (!cam.worker.wait (result)) break;
+            update_calibration_cache (cam, result);
+            if (accept_calibration (cam, result, repErrorThresh)) {
+                cout << "[cam " << cam.camId << "] Successful!!" << endl;
+                cam.done = true;
+                --nRemaining;
             }
         }
-        else
-            cout << "Frame has insufficient markers: " << ids.size() << endl;
-        
-        
+        if (!cam.done)
+            cout << "[cam " << cam.camId << "] Video capture failure!!" << endl;
     }
-    
-    cout << "Video capture failure!!" << endl;
-    return (1);
+    return (nRemaining == 0 ? 0 : 1);
 }
@@ -46,6 +46,7 @@ the use of this software, even if advised of the possibility of such damage.
 
 #include "utils/string_utils.hpp"
 #include "utils/cv_data_utils.hpp"
+#include "utils/marker_layout.hpp"
 
 using namespace std;
 using namespace cv;
@@ -58,14 +59,22 @@ const char* keys  =
         "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
         "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16}"
         "{@outfile |<none> | Output file with transformation parameters }"
-        "{v        |       | Input from video file, if ommited, input comes from camera }"
-        "{ci       | 0     | Camera id if input doesnt come from video (-v) }"
+        "{v        |       | Input from video file, if ommited, input comes from camera. With -joint, a pattern with [ci] (replaced by camera id) }"
+        "{ci       | 0     | Camera id if input doesnt come from video (-v). With -joint, a comma separated list e.g. 0,1,2 }"
+        "{layout   |       | Marker layout file (ids and 3d corners of markers, see utils/marker_layout.hpp). The camera is located from the pose of the whole layout, in layout coordinates }"
+        "{bw       |       | Use a grid board of bw x bh markers (side -l, separation -bs, in meters) as the layout }"
+        "{bh       |       | Number of markers in Y direction of the grid board (-bw) }"
+        "{bs       |       | Separation between markers of the grid board (-bw) }"
+        "{bframes  | 10    | With a layout (-layout or -bw), number of frames with a board pose to average }"
+        "{joint    | false | Solve the transformations of all cameras (-ci) together, using markers seen by several cameras as shared points. The joint least-squares fit is minimized by alternating between the camera fits and the shared marker positions, not by one simultaneous solve }"
         "{c        |       | Camera intrinsic parameters. Needed for camera pose }"
         "{l        | 0.1   | Marker side lenght (in meters). Needed for correct scale in camera pose }"
         "{dp       |       | File of marker detector parameters }"
         "{fframe   | 0.75  | The fraction of frames that should have the marker for it to be detected }"
-        "{rmaxerr  | 1e-8  | Max. allowed determinant of covariance of rvecs of a marker }"
-        "{tmaxerr  | 1e-15 | Max. allowed determinant of covariance of tvecs of a marker }"
+        "{rmaxerr  | 1e-14 | Max. allowed determinant of the sample covariance of rvecs of a marker (the determinant of the scatter matrix / (n-1)^3) }"
+        "{tmaxerr  | 1e-21 | Max. allowed determinant of the sample covariance of tvecs of a marker (the determinant of the scatter matrix / (n-1)^3) }"
+        "{minframes| 30    | Min. number of frames before the data is tested for convergence }"
+        "{maxframes| 100   | Max. number of frames to use }"
         "{r        |       | show rejected candidates too }"
         "{grcoords | u     | Ground coordinate of markers in format 'id1:(x1,y1,z1);id2:(x2,y2,z2);...;[i|u]' (no space), where the last letter ('i' or 'u') indicates whether to (i)gnore other markers or ask for (u)ser input }";
 }
@@ -139,6 +148,350 @@ unordered_map<int,Vec3d> get_ground_coords (String gCoordString, bool& ask_user_
 
 // ================================================================
 
+// True when every marker with given ground coordinates (or, if none are given, at least minGood
+// markers) has at least minCount detections and rvec/tvec covariance determinants within limits.
+bool converged (unordered_map<int,RunningStats3d>& rvec_stats, unordered_map<int,RunningStats3d>& tvec_stats,
+                const unordered_map<int,Vec3d>& required, double minCount, double rMaxErr, double tMaxErr,
+                int minGood=4) {
+    int nGood = 0;
+    for (auto it=rvec_stats.begin(); it!=rvec_stats.end(); ++it) {
+        bool good = it->second.n >= minCount && it->second.cov_det() <= rMaxErr
+                    && tvec_stats[it->first].cov_det() <= tMaxErr;
+        if (good) ++nGood;
+        else if (required.find (it->first) != required.end()) return (false);
+    }
+    if (!required.empty()) {
+        for (auto it=required.begin(); it!=required.end(); ++it)
+            if (rvec_stats.find (it->first) == rvec_stats.end()) return (false);
+        return (true);
+    }
+    return (nGood >= minGood);
+}
+
+// ================================================================
+
+/**
+ * Transformations (ground = s R camera + t) of several cameras from one least-squares problem.
+ * 'observations' holds, per camera, the mean position of each usable marker in camera
+ * coordinates. Markers with ground coordinates are fixed; any other marker seen by more than
+ * one camera is a shared unknown point. Cameras are placed as soon as they see 3 markers of
+ * known position (surveyed, or seen by cameras already placed), then marker positions (mean of
+ * their transformed observations) and camera transformations (Umeyama fits) are refined in turn
+ * until they settle. Each step is the exact minimum of the summed squared residuals over its
+ * own unknowns, so this is block coordinate descent on the joint problem rather than a
+ * simultaneous (Gauss-Newton) solve: it reaches the same kind of minimum, but convergence is
+ * linear and may stop at maxIter on weakly connected setups. Cameras that could not be placed
+ * are left out of 'transforms'.
+ */
+void solve_joint_transformation (const unordered_map<int, unordered_map<int,Vec3d> >& observations,
+                                 const unordered_map<int,Vec3d>& surveyed,
+                                 unordered_map<int,Matx34d>& transforms, int maxIter=200, double eps=1e-10) {
+    unordered_map<int,Vec3d> world;
+    auto update_markers = [&] () {
+        unordered_map<int,Vec3d> sum;
+        unordered_map<int,int> count;
+        for (auto cam=transforms.begin(); cam!=transforms.end(); ++cam) {
+            const unordered_map<int,Vec3d>& obs = observations.at(cam->first);
+            for (auto m=obs.begin(); m!=obs.end(); ++m) {
+                if (surveyed.find (m->first) != surveyed.end()) continue;
+                sum[m->first] += transform_point (cam->second, m->second);
+                ++count[m->first];
+            }
+        }
+        world = surveyed;
+        for (auto m=sum.begin(); m!=sum.end(); ++m)
+            world[m->first] = m->second * (1.0/count[m->first]);
+    };
+    auto fit_camera = [&] (int camId, Matx34d& T) {
+        vector<Vec3d> src, dst;
+        const unordered_map<int,Vec3d>& obs = observations.at(camId);
+        for (auto m=obs.begin(); m!=obs.end(); ++m)
+            if (world.find (m->first) != world.end()) {
+                src.push_back (m->second);
+                dst.push_back (world[m->first]);
+            }
+        if (src.size() < 3) return (false);
+        T = similarity_transform_3d (src, dst);
+        return (true);
+    };
+
+    // initial placement, spreading out from the surveyed markers
+    transforms.clear();
+    world = surveyed;
+    bool placed = true;
+    while (placed) {
+        placed = false;
+        for (auto cam=observations.begin(); cam!=observations.end(); ++cam) {
+            Matx34d T;
+            if (transforms.find (cam->first) == transforms.end() && fit_camera (cam->first, T)) {
+                transforms[cam->first] = T;
+                placed = true;
+            }
+        }
+        if (placed) update_markers();
+    }
+
+    // alternate between marker positions and camera transformations
+    for (int iter=0; iter<maxIter && !transforms.empty(); ++iter) {
+        double change = 0.0;
+        for (auto cam=transforms.begin(); cam!=transforms.end(); ++cam) {
+            Matx34d T;
+            fit_camera (cam->first, T);
+            for (int a=0; a<3; ++a)
+                for (int b=0; b<4; ++b)
+                    change += (T(a,b) - cam->second(a,b)) * (T(a,b) - cam->second(a,b));
+            cam->second = T;
+        }
+        update_markers();
+        if (change < eps) break;
+    }
+}
+
+// ----------------------------------------------------------------
+
+/**
+ * Layout mode: the markers of a board or layout file form a single rigid target, whose pose is
+ * estimated from all visible corners in each frame. The pose is averaged over a few frames and
+ * the camera-to-layout transformation is saved.
+ */
+int compute_layout_transformation (VideoCapture& inputVideo, int waitTime, const aruco::Board& layout,
+                                   const aruco::Dictionary& dictionary, const aruco::DetectorParameters& detectorParams,
+                                   const Mat& camMatrix, const Mat& distCoeffs, int nFrames, int maxFrames,
+                                   double rMaxErr, double tMaxErr, float axisLength, const string& outputFile) {
+    RunningStats3d rvec_stats, tvec_stats;
+    int totalIterations = 0;
+    Mat image, imageCopy;
+    while (inputVideo.grab() && totalIterations<maxFrames) {
+        inputVideo.retrieve(image);
+        totalIterations++;
+
+        vector< int > ids;
+        vector< vector< Point2f > > corners, rejected;
+        Vec3d rvec, tvec;
+        aruco::detectMarkers(image, dictionary, corners, ids, detectorParams, rejected);
+        int nUsed = 0;
+        if(ids.size() > 0)
+            nUsed = aruco::estimatePoseBoard(corners, ids, layout, camMatrix, distCoeffs, rvec, tvec);
+
+        image.copyTo (imageCopy);
+        if(ids.size() > 0) aruco::drawDetectedMarkers(imageCopy, corners, ids);
+        if(nUsed > 0) {
+            rvec_stats.add (rvec);
+            tvec_stats.add (tvec);
+            aruco::drawAxis (imageCopy, camMatrix, distCoeffs, rvec, tvec, axisLength);
+        }
+        imshow("out", imageCopy);
+        char key = (char)waitKey(waitTime);
+        if(key == 27) break;
+
+        if (rvec_stats.n >= nFrames && rvec_stats.cov_det() <= rMaxErr && tvec_stats.cov_det() <= tMaxErr)
+            break;
+    }
+
+    cout << "Layout pose found in " << rvec_stats.n << " of " << totalIterations << " frames." << endl;
+    cout << "rvec mean: " << rvec_stats.mean << ". rvec error: " << rvec_stats.cov_det() << endl;
+    cout << "tvec mean: " << tvec_stats.mean << ". tvec error: " << tvec_stats.cov_det() << endl;
+    if (rvec_stats.n < nFrames) {
+        cout << "Not enough frames with the layout in view." << endl;
+        return (1);
+    }
+    if (rvec_stats.cov_det() > rMaxErr || tvec_stats.cov_det() > tMaxErr)
+        cout << "Warning: layout pose error above threshold." << endl;
+
+    Mat_<double> trans (camera_to_board_transform (rvec_stats.mean, tvec_stats.mean));
+    cout << "Computed transfmation matrix = \n" << trans << endl;
+
+    FileStorage fs (outputFile, FileStorage::WRITE);
+    if (fs.isOpened()) {
+        fs << "transformationMatrix" << trans;
+        cout  << "Transformation matrix saved in " << outputFile << endl;
+        fs.release();
+    } else
+        cout << "Failed to save file." <<endl;
+    return 0;
+}
+
+// ----------------------------------------------------------------
+
+/**
+ * -joint mode: captures from all cameras at once, accumulates per camera and marker pose
+ * statistics as in the single camera mode, and solves all transformations together. With
+ * 'askUser' (grcoords ending in 'u') the ground coordinates of the other usable markers are asked for.
+ */
+int compute_joint_transformation (CommandLineParser& parser, const aruco::Dictionary& dictionary,
+                                  const unordered_map<int,Vec3d>& userCoords, bool askUser) {
+    unordered_map<int,Vec3d> surveyed = userCoords;
+    vector<int> camIds = parse_id_list (parser.get<string>("ci"));
+    float markerLength = parser.get<float>("l");
+    double fracFrames = parser.get<double>("fframe");
+    double rMaxErr = parser.get<double>("rmaxerr");
+    double tMaxErr = parser.get<double>("tmaxerr");
+    int minFrames = parser.get<int>("minframes");
+    int maxFrames = parser.get<int>("maxframes");
+    if (!parser.has("c")) {
+        cerr << "-joint needs camera intrinsic parameters (-c)" << endl;
+        return (1);
+    }
+
+    unordered_map<int,VideoCapture> inputVideo;
+    unordered_map<int,aruco::DetectorParameters> detectorParams;
+    unordered_map<int,Mat> camMatrix, distCoeffs;
+    unordered_map<int, unordered_map<int,RunningStats3d> > rvec_stats, tvec_stats;
+    for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+        int camId = *it;
+        unordered_map<string,string> fname_replacements = { {"[ci]", to_string(camId)} };
+        if(parser.has("dp")) {
+            bool readOk = readDetectorParameters (multi_replace(parser.get<string>("dp"),fname_replacements), detectorParams[camId]);
+            if(!readOk) {
+                cerr << "Invalid detector parameters file" << endl;
+                return (1);
+            }
+        }
+        detectorParams[camId].doCornerRefinement = true; // do corner refinement in markers
+        bool readOk = readCameraParameters (multi_replace(parser.get<string>("c"),fname_replacements), camMatrix[camId], distCoeffs[camId]);
+        if(!readOk) {
+            cerr << "Invalid camera file" << endl;
+            return (1);
+        }
+        if (parser.has("v")) inputVideo[camId].open(multi_replace(parser.get<string>("v"),fname_replacements));
+        else inputVideo[camId].open(camId);
+        if (!inputVideo[camId].isOpened()) {
+            cerr << "Could not open input for camera " << camId << endl;
+            return (1);
+        }
+    }
+    int waitTime = parser.has("v") ? 1 : 10;
+
+    int totalIterations = 0;
+    Mat image, imageCopy;
+    while (totalIterations < maxFrames) {
+        // grab from all cameras first, so that their frames are as close in time as possible
+        bool grabbedAll = true;
+        for (auto it=camIds.begin(); it!=camIds.end(); ++it)
+            grabbedAll = inputVideo[*it].grab() && grabbedAll;
+        if (!grabbedAll) break;
+        ++totalIterations;
+
+        bool allConverged = true;
+        for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+            int camId = *it;
+            inputVideo[camId].retrieve(image);
+
+            vector< int > ids;
+            vector< vector< Point2f > > corners, rejected;
+            vector< Vec3d > rvecs, tvecs;
+            aruco::detectMarkers(image, dictionary, corners, ids, detectorParams[camId], rejected);
+            if(ids.size()>0)
+                aruco::estimatePoseSingleMarkers(corners, markerLength, camMatrix[camId], distCoeffs[camId], rvecs, tvecs);
+            for(unsigned int i=0; i<ids.size(); i++) {
+                rvec_stats[camId][ids[i]].add (rvecs[i]);
+                tvec_stats[camId][ids[i]].add (tvecs[i]);
+            }
+            allConverged = allConverged && converged (rvec_stats[camId], tvec_stats[camId], unordered_map<int,Vec3d>(),
+                                                      totalIterations*fracFrames, rMaxErr, tMaxErr, 3);
+
+            image.copyTo (imageCopy);
+            if(ids.size() > 0) aruco::drawDetectedMarkers(imageCopy, corners, ids);
+            imshow("out " + to_string(camId), imageCopy);
+        }
+        char key = (char)waitKey(waitTime);
+        if(key == 27) break;
+
+        if (totalIterations % 10 == 0) {
+            cout << "Frame " << totalIterations << ". Markers detected:";
+            for (auto it=camIds.begin(); it!=camIds.end(); ++it)
+                cout << " cam " << *it << ": " << rvec_stats[*it].size();
+            cout << endl;
+        }
+        if (totalIterations >= minFrames && allConverged) {
+            cout << "Marker poses converged after " << totalIterations << " frames." << endl;
+            break;
+        }
+    }
+
+    // usable markers of each camera
+    unordered_map<int, unordered_map<int,Vec3d> > observations;
+    unordered_map<int,int> nCameras;   // number of cameras that see each marker
+    for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+        int camId = *it;
+        observations[camId];
+        for (auto m=rvec_stats[camId].begin(); m!=rvec_stats[camId].end(); ++m) {
+            const RunningStats3d& tstats = tvec_stats[camId][m->first];
+            if (m->second.n < totalIterations*fracFrames || m->second.cov_det() > rMaxErr || tstats.cov_det() > tMaxErr)
+                continue;
+            observations[camId][m->first] = tstats.mean;
+            ++nCameras[m->first];
+        }
+        cout << "Camera " << camId << ": " << observations[camId].size() << " usable markers." << endl;
+    }
+    // 'u': ground coordinates of the usable markers that were not given, as in the single camera mode;
+    // shared markers may be left to the solve
+    if (askUser) {
+        for (auto m=nCameras.begin(); m!=nCameras.end(); ++m) {
+            if (surveyed.find (m->first) != surveyed.end()) continue;
+            cout << "\nMarker " << m->first << " (usable in " << m->second << " cameras)." << endl;
+            cout << ">>> Enter ground coordinates of this marker [comma separated numbers: x, y, z ], or nothing to "
+                 << (m->second > 1 ? "solve it from the cameras: " : "skip it: ");
+            string line;
+            getline (cin, line);
+            double x, y, z;
+            if (sscanf (line.c_str(), "%lf, %lf, %lf", &x, &y, &z) == 3)
+                surveyed[m->first] = Vec3d (x, y, z);
+        }
+    }
+    // a marker that is neither surveyed nor shared adds nothing
+    for (auto it=observations.begin(); it!=observations.end(); ++it)
+        for (auto m=it->second.begin(); m!=it->second.end(); ) {
+            if (surveyed.find (m->first) == surveyed.end() && nCameras[m->first] < 2) m = it->second.erase (m);
+            else ++m;
+        }
+
+    unordered_map<int,Matx34d> transforms;
+    solve_joint_transformation (observations, surveyed, transforms);
+
+    // positions of all markers from the solved cameras, for the residuals
+    unordered_map<int,Vec3d> sum;
+    unordered_map<int,int> count;
+    for (auto cam=transforms.begin(); cam!=transforms.end(); ++cam)
+        for (auto m=observations[cam->first].begin(); m!=observations[cam->first].end(); ++m) {
+            sum[m->first] += transform_point (cam->second, m->second);
+            ++count[m->first];
+        }
+
+    int nFailed = 0;
+    for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
+        int camId = *it;
+        if (transforms.find (camId) == transforms.end()) {
+            cout << "\nCamera " << camId << ": not connected to 3 surveyed or shared markers. Not saved." << endl;
+            ++nFailed;
+            continue;
+        }
+        double sqErr = 0.0;
+        for (auto m=observations[camId].begin(); m!=observations[camId].end(); ++m) {
+            Vec3d ref = surveyed.find (m->first) != surveyed.end() ? surveyed.at(m->first) : sum[m->first] * (1.0/count[m->first]);
+            Vec3d d = transform_point (transforms[camId], m->second) - ref;
+            sqErr += d.dot(d);
+        }
+        Mat_<double> trans (transforms[camId]);
+        cout << "\nCamera " << camId << ": transformation matrix = \n" << trans << endl;
+        cout << "RMS marker residual = " << sqrt (sqErr / observations[camId].size()) << endl;
+
+        string outputFile = multi_replace(parser.get<String>(0), { {"[ci]", to_string(camId)} });
+        FileStorage fs (outputFile, FileStorage::WRITE);
+        if (fs.isOpened()) {
+            fs << "transformationMatrix" << trans;
+            cout  << "Transformation matrix saved in " << outputFile << endl;
+            fs.release();
+        } else {
+            cout << "Failed to save file." <<endl;
+            ++nFailed;
+        }
+    }
+    return (nFailed == 0 ? 0 : 1);
+}
+
+// ================================================================
+
 /**
  */
 int main(int argc, char *argv[]) {
@@ -160,6 +513,8 @@ int main(int argc, char *argv[]) {
     double fracFrames = parser.get<double>("fframe");
     double rMaxErr = parser.get<double>("rmaxerr");
     double tMaxErr = parser.get<double>("tmaxerr");
+    int minFrames = parser.get<int>("minframes");
+    int maxFrames = parser.get<int>("maxframes");
     string outputFile = multi_replace(parser.get<String>(0),fname_replacements);
     String gCoordString = parser.get<String>("grcoords");
     
@@ -191,6 +546,9 @@ int main(int argc, char *argv[]) {
     aruco::Dictionary dictionary =
         aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
 
+    if(parser.get<bool>("joint"))
+        return (compute_joint_transformation (parser, dictionary, user_ground_coords, ask_user_input));
+
     Mat camMatrix, distCoeffs;
     if(estimatePose) {
         bool readOk = readCameraParameters (multi_replace(parser.get<string>("c"),fname_replacements), camMatrix, distCoeffs);
@@ -210,15 +568,33 @@ int main(int argc, char *argv[]) {
         waitTime = 10;
     }
 
+    if(parser.has("layout") || parser.has("bw")) {
+        aruco::Board layout;
+        if(parser.has("layout")) {
+            if(!read_marker_layout (multi_replace(parser.get<string>("layout"),fname_replacements), dictionary, layout)) {
+                cerr << "Invalid marker layout file" << endl;
+                return 0;
+            }
+        }
+        else
+            layout = aruco::GridBoard::create(parser.get<int>("bw"), parser.get<int>("bh"), markerLength,
+                                              parser.get<float>("bs"), dictionary);
+        if(!estimatePose) {
+            cerr << "Camera intrinsic parameters (-c) are needed with a layout" << endl;
+            return 0;
+        }
+        return (compute_layout_transformation (inputVideo, waitTime, layout, dictionary, detectorParams, camMatrix, distCoeffs,
+                                               parser.get<int>("bframes"), maxFrames, rMaxErr, tMaxErr, markerLength, outputFile));
+    }
+
     double totalTime = 0;
     int totalIterations = 0;
-    unordered_map <int, vector<Vec3d> >  all_rvecs, all_tvecs;
+    unordered_map <int,RunningStats3d>  rvec_stats, tvec_stats;  // per marker, in constant memory
     unordered_map <int,Vec3d>  ground_coords;
-    unordered_map <int,int>  all_counts;
     
     Mat image, imageCopy;
     
-    while (inputVideo.grab() && totalIterations<100) {
+    while (inputVideo.grab() && totalIterations<maxFrames) {
         inputVideo.retrieve(image);
         double tick = (double)getTickCount();
 
@@ -239,17 +615,22 @@ int main(int argc, char *argv[]) {
                  << "(Mean = " << 1000 * totalTime / double(totalIterations) << " ms)" << endl;
         }*/
         
-        // update history
+        // update statistics
         for(unsigned int i=0; i<ids.size(); i++) {
-            all_rvecs[ids[i]].push_back (rvecs[i]);
-            all_tvecs[ids[i]].push_back (tvecs[i]);
-            if (all_counts.find(ids[i]) == all_counts.end()) all_counts[ids[i]] = 1;
-            else ++all_counts[ids[i]];
+            rvec_stats[ids[i]].add (rvecs[i]);
+            tvec_stats[ids[i]].add (tvecs[i]);
         }
         
         // Compute and print up-to-date transformation data
         if (totalIterations % 10 == 0) {
-            cout << "Markers detected: " << all_counts.size() << endl;
+            cout << "Markers detected: " << rvec_stats.size() << endl;
+        }
+
+        // stop as soon as the required markers are seen often enough and their poses have settled
+        if (totalIterations >= minFrames && converged (rvec_stats, tvec_stats, user_ground_coords,
+                                                        totalIterations*fracFrames, rMaxErr, tMaxErr)) {
+            cout << "Marker poses converged after " << totalIterations << " frames." << endl;
+            break;
         }
         
         // ------------------------------------------
@@ -276,32 +657,25 @@ int main(int argc, char *argv[]) {
     // Camera transfomation computation
     vector<Vec3d>   marker_rvecs, marker_tvecs, marker_gcoords;
     
-    cout << "Total markers detected: " << all_counts.size() << endl;
-        for (auto it=all_counts.begin(); it!=all_counts.end(); ++it) {
+    cout << "Total markers detected: " << rvec_stats.size() << endl;
+        for (auto it=rvec_stats.begin(); it!=rvec_stats.end(); ++it) {
             int marker_id = it->first;
+            int marker_count = it->second.n;
             
-            Mat_<double> marker_mean_rvec, marker_mean_tvec;
-            Mat_<double> marker_rvec_cov(3,3), marker_tvec_cov(3,3);
-            double rvec_cov_det, tvec_cov_det;
-            
-            
-            calcCovarMatrix (vectorVec3d_to_mat (all_rvecs[marker_id]), marker_rvec_cov, marker_mean_rvec, 
-                                CV_COVAR_NORMAL|CV_COVAR_ROWS);
-            calcCovarMatrix (vectorVec3d_to_mat (all_tvecs[marker_id]), marker_tvec_cov, marker_mean_tvec, 
-                                CV_COVAR_NORMAL|CV_COVAR_ROWS);
-            rvec_cov_det = determinant (marker_rvec_cov);
-            tvec_cov_det = determinant (marker_tvec_cov);
+            Vec3d marker_mean_rvec = rvec_stats[marker_id].mean, marker_mean_tvec = tvec_stats[marker_id].mean;
+            double rvec_cov_det = rvec_stats[marker_id].cov_det();
+            double tvec_cov_det = tvec_stats[marker_id].cov_det();
             
             image.copyTo (imageCopy);
             aruco::drawAxis (imageCopy, camMatrix, distCoeffs, marker_mean_rvec, marker_mean_tvec, markerLength * 0.5f);
             imshow("out", imageCopy);
             char key = (char)waitKey(waitTime);
             
-            cout << "\nMarker " << marker_id << " (" << all_counts[marker_id] << " detections)." << endl;
+            cout << "\nMarker " << marker_id << " (" << marker_count << " detections)." << endl;
             cout << "rvec mean: " << marker_mean_rvec << ". rvec error: " << rvec_cov_det << endl;
             cout << "tvec mean: " << marker_mean_tvec << ". tvec error: " << tvec_cov_det << endl;
             
-            if (all_counts[marker_id] < totalIterations*fracFrames)
+            if (marker_count < totalIterations*fracFrames)
                 cout << "Not enough detections." << endl;
             else if (rvec_cov_det > rMaxErr)
                 cout << "rvec error above threshold." << endl;
@@ -39,13 +39,17 @@ the use of this software, even if advised of the possibility of such damage.
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/aruco.hpp>
+#include <opencv2/aruco/charuco.hpp>
+#include <iostream>
+
+#include "utils/vector_drawing.hpp"
 
 using namespace cv;
 
 namespace {
-const char* about = "Create an ArUco grid board image";
+const char* about = "Create an ArUco grid board image (or a ChArUco board image, with -charuco)";
 const char* keys  =
-        "{@outfile |<none> | Output image }"
+        "{@outfile |<none> | Output image. An .svg or .pdf file gets a vector drawing with all lengths in millimetres }"
         "{w        |       | Number of markers in X direction }"
         "{h        |       | Number of markers in Y direction }"
         "{l        |       | Marker side lenght (in pixels) }"
@@ -54,7 +58,9 @@ const char* keys  =
         "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
         "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
         "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16}"
-        "{m        |       | Margins size (in pixels). Default is marker separation (-s) }"
+        "{charuco  | false | Create a ChArUco board of -w x -h chessboard squares of side -sq, with markers of side -l }"
+        "{sq       |       | Chessboard square side length of a ChArUco board (in pixels) }"
+        "{m        |       | Margins size (in pixels). Default is marker separation (-s), or -sq minus -l for a ChArUco board }"
         "{bb       | 1     | Number of bits in marker borders }"
         "{si       | false | show generated image }";
 }
@@ -70,38 +76,67 @@ int main(int argc, char *argv[]) {
 
     int markersX = parser.get<int>("w");
     int markersY = parser.get<int>("h");
-    int markerLength = parser.get<int>("l");
-    int markerSeparation = parser.get<int>("s");
+    float markerLength = parser.get<float>("l");
+    bool charuco = parser.get<bool>("charuco");
+    float markerSeparation = 0, squareLength = 0;
+    if(charuco) squareLength = parser.get<float>("sq");
+    else markerSeparation = parser.get<float>("s");
     int dictionaryId = parser.get<int>("d");
-    int margins = markerSeparation;
+    float margins = charuco ? squareLength - markerLength : markerSeparation;
     if(parser.has("m")) {
-        margins = parser.get<int>("m");
+        margins = parser.get<float>("m");
     }
 
     int borderBits = parser.get<int>("bb");
     bool showImage = parser.get<bool>("si");
 
     String out = parser.get<String>(0);
+    bool vectorOutput = is_vector_file(out);
 
     if(!parser.check()) {
         parser.printErrors();
         return 0;
     }
 
-    Size imageSize;
-    imageSize.width = markersX * (markerLength + markerSeparation) - markerSeparation + 2 * margins;
-    imageSize.height =
-        markersY * (markerLength + markerSeparation) - markerSeparation + 2 * margins;
+    Size2d boardSize;
+    if(charuco) {
+        boardSize.width = markersX * squareLength;
+        boardSize.height = markersY * squareLength;
+    }
+    else {
+        boardSize.width = markersX * (markerLength + markerSeparation) - markerSeparation;
+        boardSize.height = markersY * (markerLength + markerSeparation) - markerSeparation;
+    }
+    Size imageSize(int(boardSize.width + 2 * margins), int(boardSize.height + 2 * margins));
 
     aruco::Dictionary dictionary =
         aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
 
-    aruco::GridBoard board = aruco::GridBoard::create(markersX, markersY, float(markerLength),
-                                                      float(markerSeparation), dictionary);
+    aruco::GridBoard gridBoard;
+    aruco::CharucoBoard charucoBoard;
+    if(charuco)
+        charucoBoard = aruco::CharucoBoard::create(markersX, markersY, squareLength, markerLength, dictionary);
+    else
+        gridBoard = aruco::GridBoard::create(markersX, markersY, markerLength, markerSeparation, dictionary);
+
+    // vector drawing, sized in millimetres
+    if(vectorOutput) {
+        VectorPage page;
+        if(charuco) draw_board_vector(charucoBoard, boardSize, margins, borderBits, squareLength, page);
+        else draw_board_vector(gridBoard, boardSize, margins, borderBits, 0, page);
+        if(!write_vector_page(out, page)) {
+            std::cerr << "Could not write " << out << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
     // show created board
     Mat boardImage;
-    board.draw(imageSize, boardImage, margins, borderBits);
+    if(charuco)
+        charucoBoard.draw(imageSize, boardImage, int(margins), borderBits);
+    else
+        gridBoard.draw(imageSize, boardImage, int(margins), borderBits);
 
     if(showImage) {
         imshow("board", boardImage);
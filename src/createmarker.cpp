@@ -39,37 +39,131 @@ the use of this software, even if advised of the possibility of such damage.
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/aruco.hpp>
+#include <opencv2/imgproc.hpp>
+#include <iostream>
+#include <algorithm>
 
+#include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/pdf_writer.hpp"
+#include "utils/vector_drawing.hpp"
+
+using namespace std;
 using namespace cv;
 
 namespace {
-const char* about = "Create an ArUco marker image";
+const char* about = "Create an ArUco marker image, or a multi-page PDF of labelled marker pages (with -ids)";
 const char* keys  =
-        "{@outfile |<none> | Output image }"
+        "{@outfile |<none> | Output image. An .svg or .pdf file gets a vector drawing, with -ms in millimetres }"
         "{d        |       | dictionary: DICT_4X4_50=0, DICT_4X4_100=1, DICT_4X4_250=2,"
         "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
         "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
         "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16}"
         "{id       |       | Marker id in the dictionary }"
-        "{ms       | 200   | Marker size in pixels }"
+        "{ids      |       | Marker ids for a PDF with one page per marker, e.g. '0-29,40' (no space). The output file is then the PDF }"
+        "{pw       | 1700  | Page width (in pixels) for -ids }"
+        "{ph       | 2200  | Page height (in pixels) for -ids }"
+        "{dpi      | 200   | Print resolution of the pages for -ids }"
+        "{nthreads | 0     | Number of page rendering threads for -ids (0: one per core) }"
+        "{vector   | false | Draw the -ids pages as vector graphics instead of 1-bit images }"
+        "{ms       | 200   | Marker size in pixels (millimetres for an .svg or .pdf output file) }"
         "{bb       | 1     | Number of bits in marker borders }"
         "{si       | false | show generated image }";
 }
 
 
+bool finish_marker_pages(PdfWriter& pdf, const String& out) {
+    int pages = pdf.page_count();
+    if(!pdf.close()) {
+        cerr << "Could not write " << out << endl;
+        return false;
+    }
+    cout << "Wrote " << pages << " marker pages to " << out << endl;
+    return true;
+}
+
+
+/**
+ * Renders one page per marker id: the marker centred on a white page, labelled
+ * "dictionary:id" in the top left corner. Pages are rendered and encoded on a thread pool
+ * a batch at a time and appended to a single PDF whose page size follows from -dpi.
+ */
+bool create_marker_pages(const CommandLineParser& parser, const aruco::Dictionary& dictionary, int dictionaryId,
+                         int markerSize, int borderBits, const String& out) {
+    vector<int> ids = parse_id_list(parser.get<string>("ids"));
+    int pageWidth = parser.get<int>("pw");
+    int pageHeight = parser.get<int>("ph");
+    double dpi = parser.get<double>("dpi");
+    if(markerSize > pageWidth || markerSize > pageHeight) {
+        cerr << "Marker does not fit on the page" << endl;
+        return false;
+    }
+
+    PdfWriter pdf;
+    if(!pdf.open(out)) {
+        cerr << "Could not open " << out << endl;
+        return false;
+    }
+
+    // same layout as vector drawings, in millimetres: nothing to render, so no threads
+    if(parser.get<bool>("vector")) {
+        double mm = 25.4 / dpi;
+        for(int i = 0; i < ids.size(); ++i) {
+            VectorPage page(pageWidth * mm, pageHeight * mm);
+            draw_marker_vector(dictionary, ids[i], borderBits, Point2d((pageWidth - markerSize) / 2 * mm, (pageHeight - markerSize) / 2 * mm),
+                               markerSize * mm, page);
+            VectorText label = { Point2d(6.35, 12.7), 6.35, to_string(dictionaryId) + ":" + to_string(ids[i]) };
+            page.texts.push_back(label);
+            add_pdf_page(pdf, page);
+        }
+        return finish_marker_pages(pdf, out);
+    }
+
+    // label about 1/4 inch high, 1/4 inch from the top left corner
+    double fontScale = dpi / 4.0 / 22.0;
+    int thickness = max(1, (int)(fontScale * 2));
+    Point labelOrigin((int)(dpi / 4), (int)(dpi / 2));
+    Rect markerRect((pageWidth - markerSize) / 2, (pageHeight - markerSize) / 2, markerSize, markerSize);
+
+    ThreadPool pool(parser.get<int>("nthreads"));
+    vector<Mat> pages(pool.size()), markers(pool.size());
+    vector<PdfWriter::Bilevel> encoded;
+    for(int first = 0; first < ids.size(); first += pool.size()) {
+        int count = min(pool.size(), (int)ids.size() - first);
+        encoded.resize(count);
+        pool.parallel_for(count, [&](int i) {
+            int id = ids[first + i];
+            Mat& page = pages[i];
+            page.create(pageHeight, pageWidth, CV_8UC1);
+            page.setTo(Scalar::all(255));
+            aruco::drawMarker(dictionary, id, markerSize, markers[i], borderBits);
+            markers[i].copyTo(page(markerRect));
+            putText(page, to_string(dictionaryId) + ":" + to_string(id), labelOrigin, FONT_HERSHEY_SIMPLEX,
+                    fontScale, Scalar::all(0), thickness, LINE_8);
+            PdfWriter::encode_bilevel(page, encoded[i]);
+        });
+        for(int i = 0; i < count; ++i)
+            pdf.add_page(pageWidth * 72.0 / dpi, pageHeight * 72.0 / dpi, "", &encoded[i]);
+    }
+
+    return finish_marker_pages(pdf, out);
+}
+
+
 int main(int argc, char *argv[]) {
     CommandLineParser parser(argc, argv, keys);
     parser.about(about);
 
-    if(argc < 4) {
+    if(argc < 3) {
         parser.printMessage();
         return 0;
     }
 
     int dictionaryId = parser.get<int>("d");
     int markerId = parser.get<int>("id");
+    bool multiPage = parser.has("ids");
     int borderBits = parser.get<int>("bb");
-    int markerSize = parser.get<int>("ms");
+    float markerSize = parser.get<float>("ms");
     bool showImage = parser.get<bool>("si");
 
     String out = parser.get<String>(0);
@@ -82,8 +176,21 @@ int main(int argc, char *argv[]) {
     aruco::Dictionary dictionary =
         aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
 
+    if(multiPage)
+        return (create_marker_pages(parser, dictionary, dictionaryId, int(markerSize), borderBits, out) ? 0 : 1);
+
+    if(is_vector_file(out)) {
+        VectorPage page(markerSize, markerSize);
+        draw_marker_vector(dictionary, markerId, borderBits, Point2d(0, 0), markerSize, page);
+        if(!write_vector_page(out, page)) {
+            cerr << "Could not write " << out << endl;
+            return 1;
+        }
+        return 0;
+    }
+
     Mat markerImg;
-    aruco::drawMarker(dictionary, markerId, markerSize, markerImg, borderBits);
+    aruco::drawMarker(dictionary, markerId, int(markerSize), markerImg, borderBits);
 
     if(showImage) {
         imshow("marker", markerImg);
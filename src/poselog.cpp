@@ -0,0 +1,180 @@
+/*
+By downloading, copying, installing or using the software you agree to this
+license. If you do not agree to this license, do not download, install,
+copy or use the software.
+
+                          License Agreement
+               For Open Source Computer Vision Library
+                       (3-clause BSD License)
+
+Copyright (C) 2013, OpenCV Foundation, all rights reserved.
+Third party copyrights are property of their respective owners.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  * Neither the names of the copyright holders nor the names of the contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+This software is provided by the copyright holders and contributors "as is" and
+any express or implied warranties, including, but not limited to, the implied
+warranties of merchantability and fitness for a particular purpose are
+disclaimed. In no event shall copyright holders or contributors be liable for
+any direct, indirect, incidental, special, exemplary, or consequential damages
+(including, but not limited to, procurement of substitute goods or services;
+loss of use, data, or profits; or business interruption) however caused
+and on any theory of liability, whether in contract, strict liability,
+or tort (including negligence or otherwise) arising in any way out of
+the use of this software, even if advised of the possibility of such damage.
+*/
+
+
+#include <opencv2/core.hpp>
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "utils/string_utils.hpp"
+#include "utils/pose_log.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+const char* about =
+        "Exports a pose log written by trackmarkers -log to CSV or NumPy (.npy).\n"
+        "  Times are in seconds since the first record (Unix time with -unix). Without -o only\n"
+        "  a summary of the log is printed.\n";
+const char* keys  =
+        "{@log     |<none> | Pose log file }"
+        "{o        |       | Output file: .csv, or .npy for a structured array (t, id, cameras, tvec, headvec, cov) }"
+        "{from     |       | Start of the exported time range, in seconds since the first record }"
+        "{to       |       | End of the exported time range, in seconds since the first record }"
+        "{ids      |       | Exported ids, e.g. '0-29,40' (no space). Rigid bodies have id -1-b for body b of the bodies file }"
+        "{unix     | false | Write times as Unix time }";
+}
+
+
+// Writes the header of a .npy file holding 'count' records of the PoseRecord columns.
+static void write_npy_header (FILE* f, size_t count) {
+    string dict = "{'descr': [('t', '<f8'), ('id', '<i4'), ('cameras', '<u4'), ('tvec', '<f8', (3,)), "
+                  "('headvec', '<f8', (3,)), ('cov', '<f8', (3, 3))], 'fortran_order': False, 'shape': ("
+                  + to_string (count) + ",), }";
+    size_t total = 10 + dict.size() + 1;           // magic, version, length, dict, '\n'
+    dict += string ((64 - total % 64) % 64, ' ') + "\n";
+    unsigned short len = (unsigned short)dict.size();
+    fwrite ("\x93NUMPY\x01\x00", 1, 8, f);
+    fputc (len & 0xff, f);
+    fputc (len >> 8, f);
+    fwrite (dict.data(), 1, dict.size(), f);
+}
+
+static void write_npy_record (FILE* f, const PoseRecord& r, double t) {
+    int32_t id = r.id;
+    uint32_t cameras = r.cameras;
+    fwrite (&t, 8, 1, f);
+    fwrite (&id, 4, 1, f);
+    fwrite (&cameras, 4, 1, f);
+    fwrite (r.tvec.val, 8, 3, f);
+    fwrite (r.headvec.val, 8, 3, f);
+    fwrite (r.cov.val, 8, 9, f);
+}
+
+static void write_csv_record (FILE* f, const PoseRecord& r, double t) {
+    fprintf (f, "%.6f,%d,%u", t, r.id, r.cameras);
+    for (int k=0; k<3; ++k) fprintf (f, ",%.9g", r.tvec[k]);
+    for (int k=0; k<3; ++k) fprintf (f, ",%.9g", r.headvec[k]);
+    for (int k=0; k<9; ++k) fprintf (f, ",%.9g", r.cov.val[k]);
+    fprintf (f, "\n");
+}
+
+
+/**
+ */
+int main(int argc, char *argv[]) {
+    CommandLineParser parser(argc, argv, keys);
+    parser.about(about);
+
+    if(argc < 2) {
+        parser.printMessage();
+        return 0;
+    }
+
+    string logfile = parser.get<string>(0);
+    string outfile = parser.has("o") ? parser.get<string>("o") : "";
+    bool unixTime = parser.get<bool>("unix");
+    vector<int> ids;
+    if (parser.has("ids")) ids = parse_id_list (parser.get<string>("ids"));
+
+    if(!parser.check()) {
+        parser.printErrors();
+        return 0;
+    }
+
+    PoseLogReader log;
+    if (!log.open (logfile)) {
+        cerr << "Invalid pose log " << logfile << endl;
+        return 0;
+    }
+    if (log.size() == 0) {
+        cout << "Pose log is empty" << endl;
+        return 0;
+    }
+    double t0 = log.timestamp (0);
+
+    // records in the time range, found through the time index
+    size_t first = parser.has("from") ? log.lower_bound (t0 + parser.get<double>("from")) : 0;
+    size_t last = parser.has("to") ? log.lower_bound (t0 + parser.get<double>("to")) : log.size();
+    last = max (first, last);
+
+    if (outfile.empty()) {
+        cout << log.size() << " records in " << log.n_blocks() << " blocks, "
+             << log.timestamp (log.size()-1) - t0 << " s from Unix time " << fixed << t0 + log.clock_offset() << endl;
+        cout << last - first << " records in the selected range" << endl;
+        return 0;
+    }
+
+    bool npy = outfile.size() > 4 && outfile.substr (outfile.size()-4) == ".npy";
+    FILE* f = fopen (outfile.c_str(), npy ? "wb" : "w");
+    if (!f) {
+        cerr << "Could not write " << outfile << endl;
+        return 0;
+    }
+
+    PoseRecord r;
+    size_t count = 0;
+    if (npy) {
+        if (!ids.empty())   // the header needs the number of records first
+            for (size_t i=first; i<last; ++i) {
+                log.get (i, r);
+                if (find (ids.begin(), ids.end(), r.id) != ids.end()) ++count;
+            }
+        else count = last - first;
+        write_npy_header (f, count);
+    }
+    else
+        fprintf (f, "t,id,cameras,tx,ty,tz,hx,hy,hz,c00,c01,c02,c10,c11,c12,c20,c21,c22\n");
+
+    count = 0;
+    for (size_t i=first; i<last; ++i) {
+        log.get (i, r);
+        if (!ids.empty() && find (ids.begin(), ids.end(), r.id) == ids.end()) continue;
+        double t = unixTime ? r.timestamp + log.clock_offset() : r.timestamp - t0;
+        if (npy) write_npy_record (f, r, t);
+        else write_csv_record (f, r, t);
+        ++count;
+    }
+    fclose (f);
+    cout << count << " records written to " << outfile << endl;
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+By downloading, copying, installing or using the software you agree to this
+license. If you do not agree to this license, do not download, install,
+copy or use the software.
+
+                          License Agreement
+               For Open Source Computer Vision Library
+                       (3-clause BSD License)
+
+Copyright (C) 2013, OpenCV Foundation, all rights reserved.
+Third party copyrights are property of their respective owners.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  * Neither the names of the copyright holders nor the names of the contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+This software is provided by the copyright holders and contributors "as is" and
+any express or implied warranties, including, but not limited to, the implied
+warranties of merchantability and fitness for a particular purpose are
+disclaimed. In no event shall copyright holders or contributors be liable for
+any direct, indirect, incidental, special, exemplary, or consequential damages
+(including, but not limited to, procurement of substitute goods or services;
+loss of use, data, or profits; or business interruption) however caused
+and on any theory of liability, whether in contract, strict liability,
+or tort (including negligence or otherwise) arising in any way out of
+the use of this software, even if advised of the possibility of such damage.
+*/
+
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <iostream>
+#include <vector>
+
+#include "utils/adaptive_threshold.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+const char* about =
+        "Checks that MultiWindowThreshold (used by the built-in marker detector) gives binary images\n"
+        "  bit-identical to cv::adaptiveThreshold (ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV) for every\n"
+        "  odd window size from 3 to -maxwin, on the whole image including its borders. Each image is\n"
+        "  also checked with a few columns cut off, so the scalar tail after the SIMD loop is covered.\n"
+        "  The SIMD variant is picked at run time: build with DEFS=-DMOCAP_NO_AVX2 to check the SSE2\n"
+        "  code, or DEFS=-DMOCAP_NO_SIMD to check the scalar code alone. Exits with 1 on a mismatch.\n";
+const char* keys  =
+        "{imgs     | scripts/*.png | Image glob pattern }"
+        "{maxwin   | 53    | Largest window size checked }";
+}
+
+
+/**
+ */
+int main(int argc, char *argv[]) {
+    CommandLineParser parser(argc, argv, keys);
+    parser.about(about);
+
+    int maxWin = parser.get<int>("maxwin");
+
+    if(!parser.check()) {
+        parser.printErrors();
+        return 0;
+    }
+
+    vector<String> imageFiles;
+    glob(parser.get<string>("imgs"), imageFiles);
+    vector<Mat> images;
+    for (int a=0; a<imageFiles.size(); ++a) {
+        Mat img = imread(imageFiles[a], IMREAD_GRAYSCALE);
+        if (img.empty()) continue;
+        images.push_back(img);
+        images.push_back(img(Rect(0, 0, img.cols - 5, img.rows - 3)));   // odd size, not a multiple of the SIMD width
+    }
+    if (images.empty()) {
+        cerr << "No images found" << endl;
+        return 0;
+    }
+
+    vector<int> winSizes;
+    for (int w=3; w<=maxWin; w+=2)
+        winSizes.push_back(w);
+    const double constants[] = {7.0, 0.0, -3.0, 2.5};   // aruco's default, and zero, negative and fractional offsets
+
+    MultiWindowThreshold multiThreshold;
+    vector<Mat> multiOut;
+    Mat reference, diff;
+    int nChecked = 0, nFailed = 0;
+    for (int i=0; i<images.size(); ++i)
+        for (int c=0; c<4; ++c) {
+            multiThreshold.apply(images[i], winSizes, constants[c], multiOut);
+            for (int k=0; k<winSizes.size(); ++k) {
+                adaptiveThreshold(images[i], reference, 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV, winSizes[k], constants[c]);
+                compare(multiOut[k], reference, diff, CMP_NE);
+                int nDiff = countNonZero(diff);
+                ++nChecked;
+                if (nDiff == 0) continue;
+                ++nFailed;
+                vector<Point> where;
+                findNonZero(diff, where);
+                cout << "Mismatch in " << imageFiles[i/2] << " (" << images[i].cols << "x" << images[i].rows << "), window "
+                     << winSizes[k] << ", C " << constants[c] << ": " << nDiff << " pixels, first at " << where[0] << endl;
+            }
+        }
+
+    cout << nChecked - nFailed << " of " << nChecked << " thresholds identical to cv::adaptiveThreshold" << endl;
+    return (nFailed > 0 ? 1 : 0);
+}
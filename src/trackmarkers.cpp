@@ -43,9 +43,22 @@ the use of this software, even if advised of the possibility of such damage.
 #include <unordered_map>
 #include <cstdlib>
 #include <deque>
+#include <algorithm>
 
 #include "utils/string_utils.hpp"
 #include "utils/cv_data_utils.hpp"
+#include "utils/marker_detector.hpp"
+#include "utils/frame_source.hpp"
+#include "utils/latest_frame_grabber.hpp"
+#include "utils/frame_pool.hpp"
+#include "utils/alloc_counter.hpp"
+#include "utils/marker_layout.hpp"
+#include "utils/triangulation.hpp"
+#include "utils/deadline_scheduler.hpp"
+#include "utils/motion_gate.hpp"
+#include "utils/adaptive_params.hpp"
+#include "utils/roi_mask.hpp"
+#include "utils/pose_log.hpp"
 
 #define PI 3.141592653589793
 #define TIME_STAMP_SEC (((double)getTickCount())/getTickFrequency())
@@ -67,6 +80,26 @@ const char* keys  =
         "{l        | 0.1   | Marker side lenght (in meters). Needed for correct scale in camera pose }"
         "{dp       |       | File pattern of marker detector parameters: /path/to/file_with_[ci].yml. [ci] will be replaced by camera id. }"
         "{mposeage | 1.0   | Threshold on the age of a marker reading to consider it for computing average}"
+        "{ids      |       | Allowed marker ids, e.g. '0-29,40' (no space). If given, only these ids are decoded. }"
+        "{fd       | false | Use the built-in single-pass marker detector (implied by -ids and -adapt) }"
+        "{adapt    | 0     | Narrow the threshold windows and marker perimeters searched to those that found markers lately, with a full search every adapt frames and after a marker is lost (0: off). Uses the built-in detector }"
+        "{gray     | false | Capture raw YUYV and detect directly on the luma plane (colour conversion only for preview) }"
+        "{rec      |       | Raw recording file pattern used instead of the cameras: /path/to/rec_[ci].yuv. [ci] will be replaced by camera id. }"
+        "{recfmt   | yuyv  | Pixel format of the raw recordings: yuyv, gray, i420 or nv12 }"
+        "{recsize  | 640x480 | Frame size of the raw recordings }"
+        "{recloop  | false | Start the raw recordings over when they end }"
+        "{pv       | 1     | Show the preview every pv frames of each camera (0: no preview) }"
+        "{bodies   |       | Rigid body file: named bodies with the ids and placement of their markers (see utils/marker_layout.hpp). Each body is tracked with one pose from all its visible markers. }"
+        "{tri      | false | Triangulate the corners of markers seen by two or more cameras instead of averaging single-camera poses }"
+        "{trisync  | 0.05  | Max time difference (in seconds) between views used together for triangulation }"
+        "{budget   | 0     | Detection + pose time budget per camera frame (in ms). When a camera is over it, its load is shed in the -shed steps (0: no budget) }"
+        "{shed     | roi,scale,idle,preview | Load shedding steps, in order: roi (detect around tracked markers only), scale (half size detection), idle (lower rate for cameras without markers), preview (no preview) }"
+        "{motion   | false | Detect only where the image changed (plus around tracked markers) and keep the last results elsewhere. Replaces the roi step of -shed }"
+        "{mthresh  | 6     | Mean gray level change of an image tile that counts as motion, for -motion }"
+        "{mfull    | 30    | Scan the whole image every mfull frames, for -motion }"
+        "{mask     |       | Detection mask file pattern: /path/to/mask_[ci].png (non-zero pixels are searched) or .yml with a list of polygons. [ci] will be replaced by camera id. Perimeter rates stay relative to the whole frame; minDistanceToBorder applies to the bounding box of the mask }"
+        "{log      |       | Pose log file: every fused pose is appended to it as a binary record (export with poselog) }"
+        "{latest   | false | Grab on a separate thread per camera and always process the newest frame (bounded latency) }"
         "{r        |       | show rejected candidates too }";
 }
 
@@ -133,9 +166,19 @@ class PoseReading {
 public:
     Vec3d tvec, rvec;
     double timestamp;
-    int camid;
+    int camid;                  // -1: triangulated, tvec and headvec are already in ground coordinates
+    Vec3d headvec;
+    unsigned int cameras;       // triangulated: the cameras of the views
     
-    PoseReading (Vec3d tv, Vec3d rv, double t, int c): tvec(tv), rvec(rv), timestamp(t), camid(c) { }
+    PoseReading (Vec3d tv, Vec3d rv, double t, int c): tvec(tv), rvec(rv), timestamp(t), camid(c), cameras(0) { }
+    
+    // A reading triangulated from the views of 'cams', already in ground coordinates.
+    static PoseReading triangulated (Vec3d position, Vec3d hv, double t, unsigned int cams) {
+        PoseReading r (position, Vec3d(0,0,0), t, -1);
+        r.headvec = hv;
+        r.cameras = cams;
+        return (r);
+    }
 };
 
 
@@ -152,6 +195,79 @@ Mat vec_to_Mat (vector<double> v, VecType vt=ROW_VEC) {
 }
 
 
+// Averages the recent readings of a marker or body in ground coordinates and prints them,
+// and adds the average to 'logRecords' (as logId) if it is given.
+void print_ground_pose (const string& label, deque<PoseReading>& stamped_poses, unordered_map<int,Mat>& transformationMatrix,
+                        unordered_map<int,Mat>& transformationMatrix3x3, int max_queue_size, double max_pose_age,
+                        vector<PoseRecord>* logRecords, int logId) {
+    vector<Vec3d> headvecs, tvecs;
+    Mat_<double> marker_mean_headvec, marker_mean_tvec;
+    Mat_<double> marker_headvec_cov(3,3), marker_tvec_cov(3,3);
+    
+    // pop old marker poses
+    while (stamped_poses.size() > max_queue_size)
+        stamped_poses.pop_front();
+    
+    // Compute average
+    // ---------------
+    double now = TIME_STAMP_SEC;
+    int count = 0;
+    unsigned int cameras = 0;
+    double newest = 0.0;   // capture time of the newest averaged reading
+    for (auto it2=stamped_poses.begin(); it2!=stamped_poses.end(); ++it2) 
+        if (now - it2->timestamp < max_pose_age) {
+            newest = max (newest, it2->timestamp);
+            if (it2->camid >= 0 && it2->camid < 32) cameras |= 1u << it2->camid;
+            if (it2->camid < 0) {   // triangulated
+                cameras |= it2->cameras;
+                tvecs.push_back (it2->tvec);
+                headvecs.push_back (it2->headvec);
+                ++count;
+                continue;
+            }
+            
+            // transform tvec
+            Mat hom_tvec = vec_to_Mat ({it2->tvec[0], it2->tvec[1], it2->tvec[2], 1.0}, COL_VEC); 
+            hom_tvec = transformationMatrix[it2->camid] * hom_tvec;
+            tvecs.push_back (Vec3d (hom_tvec.at<double>(0), hom_tvec.at<double>(1), hom_tvec.at<double>(2)));
+            
+            // transform rvec
+            Mat rvec = vec_to_Mat ({it2->rvec[0], it2->rvec[1], it2->rvec[2]}, COL_VEC);
+            Mat_<double> rmat(3,3);
+            Rodrigues (rvec, rmat); // rmat * camera_coord_vec = marker_ccord_vec
+                                    // => ground_coord_vec = transformationMatrix3x3 * camera_coord_vec
+                                    //                    = transformationMatrix3x3 * inv(rmat) * marker_ccord_vec
+            Mat headvec = transformationMatrix3x3[it2->camid] * rmat.inv() * vec_to_Mat ({1.0,0.0,0.0}, COL_VEC);
+            headvecs.push_back (Vec3d (headvec.at<double>(0), headvec.at<double>(1), headvec.at<double>(2)));
+            
+            ++count;
+        }
+    
+    if (count > 0) {
+        calcCovarMatrix (vectorVec3d_to_mat (headvecs), marker_headvec_cov, marker_mean_headvec, 
+                        CV_COVAR_NORMAL|CV_COVAR_ROWS);
+        calcCovarMatrix (vectorVec3d_to_mat (tvecs), marker_tvec_cov, marker_mean_tvec, 
+                        CV_COVAR_NORMAL|CV_COVAR_ROWS);
+        double heading_degrees = atan2(marker_mean_headvec.at<double>(1),marker_mean_headvec.at<double>(0)) * 180.0 / PI;
+        
+        // print
+        cout << label << " in ground coordinates:\n\ttvec = " << marker_mean_tvec << "\n\theadvec = " << marker_mean_headvec << " (heading = " << heading_degrees << " degrees)" << endl;
+        
+        if (logRecords) {
+            PoseRecord r;
+            r.timestamp = newest;
+            r.id = logId;
+            r.cameras = cameras;
+            r.tvec = Vec3d (marker_mean_tvec(0), marker_mean_tvec(1), marker_mean_tvec(2));
+            r.headvec = Vec3d (marker_mean_headvec(0), marker_mean_headvec(1), marker_mean_headvec(2));
+            // calcCovarMatrix gives the scatter matrix; sample covariance as in computetransformation
+            r.cov = count > 1 ? Matx33d (Mat (marker_tvec_cov * (1.0 / (count-1)))) : Matx33d::zeros();
+            logRecords->push_back (r);
+        }
+    }
+}
+
+
 /**
  */
 int main(int argc, char *argv[]) {
@@ -167,14 +283,37 @@ int main(int argc, char *argv[]) {
     bool showRejected = parser.has("r");
     bool estimatePose = parser.has("c");
     float markerLength = parser.get<float>("l");
+    int previewEvery = parser.get<int>("pv");
+    bool latestOnly = parser.get<bool>("latest");
+    bool motionGating = parser.get<bool>("motion");
+    bool triangulate = estimatePose && parser.get<bool>("tri");
+    double triMaxSkew = parser.get<double>("trisync");
     int waitTime;
     
     aruco::Dictionary dictionary =
         aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
     
+    int adaptEvery = parser.get<int>("adapt");
+    bool useMarkerDetector = parser.has("ids") || parser.get<bool>("fd") || adaptEvery > 0;
+    vector<int> allowedIds;
+    if (parser.has("ids")) allowedIds = parse_id_list (parser.get<string>("ids"));
+    
     string camIdstring = parser.get<string>("ci");
     cout << "camIdstring: " << camIdstring << endl;
     vector<int> camIds = get_cam_ids (camIdstring);
+
+    // rigid bodies, and the body each of their markers belongs to
+    vector<RigidBody> bodies;
+    unordered_map<int,int> markerBody;
+    if (parser.has("bodies")) {
+        if (!read_rigid_bodies (parser.get<string>("bodies"), dictionary, bodies)) {
+            cerr << "Invalid rigid body file" << endl;
+            return 0;
+        }
+        for (int b=0; b<bodies.size(); ++b)
+            for (int a=0; a<bodies[b].board.ids.size(); ++a)
+                markerBody[bodies[b].board.ids[a]] = b;
+    }
     
     /*String video;
     if(parser.has("v")) {
@@ -185,8 +324,21 @@ int main(int argc, char *argv[]) {
     // Initiate for each cam:
     
     unordered_map<int,aruco::DetectorParameters> detectorParams;
+    unordered_map<int,MarkerDetector> markerDetector;
+    unordered_map<int,AdaptiveDetectorParams> adaptiveParams;
     unordered_map<int,Mat> camMatrix, distCoeffs, transformationMatrix, transformationMatrix3x3;
-    unordered_map<int,VideoCapture> inputVideo;
+    unordered_map<int,Ptr<FrameSource> > frameSource;
+    unordered_map<int,Ptr<LatestFrameGrabber> > frameGrabber;
+    unordered_map<int,int> frameCount, skippedFrames;
+    unordered_map<int,FramePool> framePool;
+    unordered_map<int,MotionGate> motionGate;
+    unordered_map<int,DetectionResult> lastDetection;   // for -motion: results kept for unchanged image regions
+    unordered_map<int,RoiMask> roiMask;
+    MultiViewTriangulator triangulator (markerLength);
+    PoseLogWriter poseLog;
+    vector<PoseRecord> roundRecords;            // -log: averages of the current round
+    unordered_map<int,double> lastLogged;       // -log: capture time of the last record of each id
+    DeadlineScheduler scheduler (parser.get<double>("budget") / 1000.0, parse_shed_steps (parser.get<string>("shed")));
     
     for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
         int camId = *it;
@@ -201,6 +353,10 @@ int main(int argc, char *argv[]) {
             }
         }
         detectorParams[camId].doCornerRefinement = true; // do corner refinement in markers
+        if (useMarkerDetector)
+            markerDetector[camId] = MarkerDetector (dictionary, detectorParams[camId], allowedIds);
+        if (adaptEvery > 0)
+            adaptiveParams[camId] = AdaptiveDetectorParams (detectorParams[camId], adaptEvery);
         
         // ----------------------------
         
@@ -224,30 +380,67 @@ int main(int argc, char *argv[]) {
         
         cout << "transformationMatrix[camId]: " << transformationMatrix[camId] << endl;
         cout << "transformationMatrix3x3[camId]: " << transformationMatrix3x3[camId] << endl;
+        if (triangulate)
+            triangulator.set_camera (camId, camMatrix[camId], distCoeffs[camId], transformationMatrix[camId]);
         
-        /*int waitTime;
-        if(!video.empty()) {
-            inputVideo[camId].open(video);
-            waitTime = 0;
-        } else { */
-            inputVideo[camId].open(camId);
-            waitTime = 10;
-        //}
+        if (parser.has("rec")) {
+            int recWidth=0, recHeight=0;
+            sscanf (parser.get<string>("recsize").c_str(), "%dx%d", &recWidth, &recHeight);
+            frameSource[camId] = Ptr<FrameSource> (new RawFileFrameSource (multi_replace(parser.get<string>("rec"),fname_replacements),
+                                                                         parser.get<string>("recfmt"), recWidth, recHeight,
+                                                                         parser.get<bool>("recloop")));
+        }
+        else
+            frameSource[camId] = Ptr<FrameSource> (new CaptureFrameSource (camId, parser.get<bool>("gray")));
+        if (!frameSource[camId]->isOpened()) {
+            cerr << "Could not open input for camera " << camId << endl;
+            return 0;
+        }
+        frameCount[camId] = 0;
+        skippedFrames[camId] = 0;
+        motionGate[camId] = MotionGate (8, 8, parser.get<double>("mthresh"), parser.get<int>("mfull"));
+        if (parser.has("mask") && !roiMask[camId].load (multi_replace(parser.get<string>("mask"),fname_replacements))) {
+            cerr << "Invalid mask file for camera " << camId << endl;
+            return 0;
+        }
+        if (latestOnly) {
+            frameGrabber[camId] = Ptr<LatestFrameGrabber> (new LatestFrameGrabber (frameSource[camId]));
+            frameGrabber[camId]->start();
+        }
+        waitTime = 10;
     }
     
 
     
 
+    if (motionGating && parser.get<int>("mfull") <= 0) {
+        cerr << "-mfull must be at least 1" << endl;
+        return 0;
+    }
     if(!parser.check()) {
         parser.printErrors();
         return 0;
     }
+    
+    if (parser.has("log") && !poseLog.open (parser.get<string>("log"))) {
+        cerr << "Could not create pose log " << parser.get<string>("log") << endl;
+        return 0;
+    }
 
     double totalTime = 0;
     int totalIterations = 0;
     bool stop=false;
     
     unordered_map <int, deque<PoseReading> >  marker_pose;
+    unordered_map <string, deque<PoseReading> >  body_pose;
+    vector< int > looseIds;                          // detected markers not on a rigid body
+    vector< vector< Point2f > > looseCorners, spareCorners;
+    vector< Vec3d > bodyRvecs, bodyTvecs;
+    vector< bool > bodyFound;
+    vector< Rect > detectRegions;
+    DetectionResult regionDet;
+    vector< pair<int,PoseReading> > pendingReadings;  // single-camera readings, kept if the marker is not triangulated
+    vector< MultiViewTriangulator::Marker > triangulated;
     int max_queue_size = 100;
     double max_pose_age = parser.get<double>("mposeage"); 
     
@@ -256,41 +449,209 @@ int main(int argc, char *argv[]) {
         for (auto it=camIds.begin(); it!=camIds.end(); ++it) {
             int camId = *it;
             
-            inputVideo[camId].grab();
-            
-            Mat image, imageCopy;
-            inputVideo[camId].retrieve(image);
+            // detection works on the gray image; colour is only produced for the preview.
+            // Frame buffers and detection results are recycled from frame to frame.
+            FrameSlot& frame = framePool[camId].acquire();
+            Mat& image = frame.image;
+            Mat& imageCopy = frame.preview;
+            long allocsBefore = allocation_count();
+            double frameTimestamp;
+            if (latestOnly) {
+                int skipped = 0;
+                if (!frameGrabber[camId]->fetch (image, frameTimestamp, skipped)) {
+                    cerr << "No more frames from camera " << camId << endl;
+                    stop = true;
+                    break;
+                }
+                skippedFrames[camId] += skipped;
+            }
+            else {
+                if (!frameSource[camId]->grab()) {
+                    cerr << "No more frames from camera " << camId << endl;
+                    stop = true;
+                    break;
+                }
+                frameTimestamp = TIME_STAMP_SEC;
+                frameSource[camId]->retrieve_gray (image);
+            }
+            if (!scheduler.process_frame (camId)) {
+                framePool[camId].release (frame);
+                if ((char)waitKey(1) == 27) stop = true;   // ESC still works on frames that are not shown
+                continue;
+            }
 
             double tick = (double)getTickCount();
 
-            vector< int > ids;
-            vector< vector< Point2f > > corners, rejected;
-            vector< Vec3d > rvecs, tvecs;
+            vector< int >& ids = frame.det.ids;
+            vector< vector< Point2f > >& corners = frame.det.corners;
+            vector< vector< Point2f > >& rejected = frame.det.rejected;
+            vector< Vec3d >& rvecs = frame.det.rvecs;
+            vector< Vec3d >& tvecs = frame.det.tvecs;
+
+            // detect markers (on a region and/or a downscaled copy when over budget, and only where
+            // the image changed with -motion) and estimate pose
+            // 'img' shows the region 'crop' of the frame (possibly scaled). The perimeter rates are relative to the
+            // larger side of the detection input, so they are scaled by frame/crop size to keep them relative to the frame.
+            auto detect_markers = [&] (const Mat& img, Rect crop, DetectionResult& det) {
+                double rateScale = (double)max (image.cols, image.rows) / max (crop.width, crop.height);
+                aruco::DetectorParameters& params = useMarkerDetector ? markerDetector[camId].params : detectorParams[camId];
+                double minRate = params.minMarkerPerimeterRate, maxRate = params.maxMarkerPerimeterRate;
+                params.minMarkerPerimeterRate *= rateScale;
+                params.maxMarkerPerimeterRate *= rateScale;
+                if (useMarkerDetector) {
+                    markerDetector[camId].detect (img, det);
+                    vector<double>& rates = markerDetector[camId].markerPerimeterRates;
+                    for (int i=0; i<rates.size(); ++i) rates[i] /= rateScale;
+                }
+                else
+                    aruco::detectMarkers (img, dictionary, det.corners, det.ids, params, det.rejected);
+                params.minMarkerPerimeterRate = minRate;
+                params.maxMarkerPerimeterRate = maxRate;
+            };
+            // with a mask, detection runs on the masked crop of the image (baseRect in image coordinates)
+            Mat detectBase = image;
+            Rect baseRect (0, 0, image.cols, image.rows);
+            bool masked = !roiMask[camId].empty();
+            if (masked) {
+                roiMask[camId].apply (image, frame.masked);
+                detectBase = frame.masked;
+                baseRect = roiMask[camId].bounds();
+            }
+            double scale = scheduler.detection_scale (camId);
+            if (motionGating)
+                motionGate[camId].regions (image, lastDetection[camId].corners, detectRegions);
+            else
+                detectRegions.assign (1, scheduler.detection_roi (camId, image.size()));
+            bool wholeFrame = detectRegions.size() == 1 && detectRegions[0].size() == image.size() && scale == 1.0;
+            if (adaptEvery > 0)  // narrowed on whole frames only: the learned perimeter rates are relative to the frame size
+                adaptiveParams[camId].prepare (markerDetector[camId], wholeFrame);
+            if (wholeFrame) {
+                detect_markers (detectBase, baseRect, frame.det);
+                if (masked) {
+                    corners_to_image (frame.det.corners, baseRect, 1.0);
+                    corners_to_image (frame.det.rejected, baseRect, 1.0);
+                }
+            }
+            else {
+                frame.det.clear();
+                for (int r=0; r<detectRegions.size(); ++r) {
+                    Rect region = detectRegions[r] & baseRect;
+                    if (region.area() == 0) continue;
+                    Mat detectImage = detectBase (region - baseRect.tl());
+                    if (scale != 1.0) {
+                        resize (detectImage, frame.scaled, Size(), scale, scale, INTER_AREA);
+                        detectImage = frame.scaled;
+                    }
+                    detect_markers (detectImage, region, regionDet);
+                    corners_to_image (regionDet.corners, region, scale);
+                    corners_to_image (regionDet.rejected, region, scale);
+                    for (int i=0; i<regionDet.ids.size(); ++i)
+                        frame.det.append_marker (regionDet.ids[i], regionDet.corners[i]);
+                    for (int i=0; i<regionDet.rejected.size(); ++i)
+                        frame.det.append_rejected (regionDet.rejected[i]);
+                }
+            }
+            if (adaptEvery > 0)
+                adaptiveParams[camId].update (markerDetector[camId], ids);
+            if (motionGating) {
+                // markers outside the detected regions have not changed: keep them from the last detection
+                DetectionResult& last = lastDetection[camId];
+                for (int k=0; k<last.ids.size(); ++k) {
+                    bool covered = false;
+                    for (int r=0; r<detectRegions.size() && !covered; ++r)
+                        for (int j=0; j<last.corners[k].size() && !covered; ++j)
+                            covered = detectRegions[r].contains (Point ((int)last.corners[k][j].x, (int)last.corners[k][j].y));
+                    if (!covered && find (ids.begin(), ids.end(), last.ids[k]) == ids.end())
+                        frame.det.append_marker (last.ids[k], last.corners[k]);
+                }
+                last.assign_markers (ids, corners);
+            }
 
-            // detect markers and estimate pose
-            aruco::detectMarkers (image, dictionary, corners, ids, detectorParams[camId], rejected);
-            if(estimatePose && ids.size() > 0)
-                aruco::estimatePoseSingleMarkers (corners, markerLength, camMatrix[camId], distCoeffs[camId], rvecs, tvecs);
+            // markers on a rigid body only contribute to the body's pose: one solve per body from all its corners
+            bodyFound.assign (bodies.size(), false);
+            bodyRvecs.resize (bodies.size());
+            bodyTvecs.resize (bodies.size());
+            if (estimatePose && !bodies.empty()) {
+                int nLoose = 0;
+                for (unsigned int i = 0; i < ids.size(); i++)
+                    if (markerBody.find (ids[i]) == markerBody.end()) ++nLoose;
+                looseIds.clear();
+                recycle_resize (looseCorners, spareCorners, nLoose);
+                for (unsigned int i = 0; i < ids.size(); i++) {
+                    auto body = markerBody.find (ids[i]);
+                    if (body != markerBody.end()) {
+                        bodyFound[body->second] = true;
+                        continue;
+                    }
+                    looseCorners[looseIds.size()].assign (corners[i].begin(), corners[i].end());
+                    looseIds.push_back (ids[i]);
+                }
+                for (int b=0; b<bodies.size(); ++b)
+                    if (bodyFound[b])
+                        bodyFound[b] = aruco::estimatePoseBoard (corners, ids, bodies[b].board, camMatrix[camId], distCoeffs[camId],
+                                                                 bodyRvecs[b], bodyTvecs[b]) > 0;
+            }
+            vector< int >& poseIds = bodies.empty() ? ids : looseIds;
+            vector< vector< Point2f > >& poseCorners = bodies.empty() ? corners : looseCorners;
+            if(estimatePose && poseIds.size() > 0)
+                aruco::estimatePoseSingleMarkers (poseCorners, markerLength, camMatrix[camId], distCoeffs[camId], rvecs, tvecs);
 
             double currentTime = ((double)getTickCount() - tick) / getTickFrequency();
+            scheduler.report (camId, currentTime, corners, image.size());
+            long frameAllocs = allocation_count() - allocsBefore;
             totalTime += currentTime;
             totalIterations++;
             if(totalIterations % 30 == 0) {
                 cout << "Detection Time = " << currentTime * 1000 << " ms "
-                     << "(Mean = " << 1000 * totalTime / double(totalIterations) << " ms)" << endl;
+                     << "(Mean = " << 1000 * totalTime / double(totalIterations) << " ms)";
+                if (latestOnly)
+                    cout << ". Frames skipped by camera " << camId << ": " << skippedFrames[camId]
+                         << ", frame age: " << (TIME_STAMP_SEC - frameTimestamp) * 1000 << " ms";
+                if (allocation_counting())
+                    cout << ". Heap allocations in capture+detection: " << frameAllocs;
+                if (adaptEvery > 0)
+                    cout << ". Detector search: " << adaptiveParams[camId].describe();
+                if (motionGating)
+                    cout << ". Area detected: " << motionGate[camId].last_coverage() * 100 << " %";
+                if (scheduler.enabled())
+                    cout << ". Load shedding level of camera " << camId << ": " << scheduler.level_description (camId)
+                         << " (mean " << scheduler.mean_time (camId) * 1000 << " ms)";
+                cout << endl;
             }
 
-            // draw and aggregate results
-            image.copyTo (imageCopy);
+            // aggregate results
+            if(estimatePose) {
+                for(unsigned int i = 0; i < poseIds.size(); i++) {
+                    if (triangulate) {
+                        triangulator.add_observation (camId, poseIds[i], poseCorners[i], frameTimestamp);
+                        pendingReadings.push_back (make_pair (poseIds[i], PoseReading (tvecs[i], rvecs[i], frameTimestamp, camId)));
+                    }
+                    else
+                        marker_pose[poseIds[i]].push_back ( PoseReading (tvecs[i], rvecs[i], frameTimestamp, camId) );
+                }
+                for(int b = 0; b < bodies.size(); b++)
+                    if (bodyFound[b])
+                        body_pose[bodies[b].name].push_back ( PoseReading (bodyTvecs[b], bodyRvecs[b], frameTimestamp, camId) );
+            }
+
+            // draw results
+            if (previewEvery <= 0 || (frameCount[camId]++) % previewEvery != 0 || !scheduler.show_preview (camId)) {
+                framePool[camId].release (frame);
+                if ((char)waitKey(1) == 27) stop = true;
+                continue;
+            }
+            if (latestOnly)
+                cvtColor (image, imageCopy, COLOR_GRAY2BGR); // the source buffer belongs to the grabber thread
+            else
+                frameSource[camId]->retrieve_color (imageCopy);
             if (ids.size() > 0) {
                 aruco::drawDetectedMarkers (imageCopy, corners, ids);
                 if(estimatePose) {
-                    for(unsigned int i = 0; i < ids.size(); i++) {
-                        // draw
+                    for(unsigned int i = 0; i < poseIds.size(); i++)
                         aruco::drawAxis (imageCopy, camMatrix[camId], distCoeffs[camId], rvecs[i], tvecs[i], markerLength * 0.5f);
-                        // aggregate
-                        marker_pose[ids[i]].push_back ( PoseReading (tvecs[i], rvecs[i], TIME_STAMP_SEC, camId) );
-                    }
+                    for(int b = 0; b < bodies.size(); b++)
+                        if (bodyFound[b])
+                            aruco::drawAxis (imageCopy, camMatrix[camId], distCoeffs[camId], bodyRvecs[b], bodyTvecs[b], markerLength);
                 }
             }
 
@@ -298,57 +659,55 @@ int main(int argc, char *argv[]) {
                 aruco::drawDetectedMarkers(imageCopy, rejected, noArray(), Scalar(100, 0, 255));
 
             imshow (string("out")+to_string(camId), imageCopy);
+            framePool[camId].release (frame);
             char key = (char)waitKey(waitTime);
             if(key == 27) stop=true;
         }
         
+        // markers seen by several cameras: pose from the triangulated corners instead of their single-camera
+        // readings of this round; the others fall back to PnP
+        if (triangulate) {
+            triangulator.triangulate (triangulated, triMaxSkew);
+            for (int a=0; a<triangulated.size(); ++a) {
+                const MultiViewTriangulator::Marker& m = triangulated[a];
+                // joins the marker's history, averaged (and logged) with its other readings below
+                marker_pose[m.id].push_back (PoseReading::triangulated (m.position, m.headvec, m.timestamp, m.cameras));
+            }
+            for (int a=0; a<pendingReadings.size(); ++a) {
+                bool done = false;
+                for (int b=0; b<triangulated.size() && !done; ++b)
+                    done = triangulated[b].id == pendingReadings[a].first;
+                if (!done) marker_pose[pendingReadings[a].first].push_back (pendingReadings[a].second);
+            }
+            pendingReadings.clear();
+            triangulator.clear();
+        }
         
         for (auto it=marker_pose.begin(); it!=marker_pose.end(); ++it) {
-            /*int& marker_id = it->first;
-            deque< PoseReading >&  stamped_poses = it->second;*/
-            vector<Vec3d> headvecs, tvecs;
-            Mat_<double> marker_mean_headvec, marker_mean_tvec;
-            Mat_<double> marker_headvec_cov(3,3), marker_tvec_cov(3,3);
-            
-            // pop old marker poses
-            while (it->second.size() > max_queue_size)
-                it->second.pop_front();
-            
-            // Compute average
-            // ---------------
-            double now = TIME_STAMP_SEC;
-            int count = 0;
-            for (auto it2=it->second.begin(); it2!=it->second.end(); ++it2) 
-                if (now - it2->timestamp < max_pose_age) {
-                    
-                    // transform tvec
-                    Mat hom_tvec = vec_to_Mat ({it2->tvec[0], it2->tvec[1], it2->tvec[2], 1.0}, COL_VEC); 
-                    hom_tvec = transformationMatrix[it2->camid] * hom_tvec;
-                    tvecs.push_back (Vec3d (hom_tvec.at<double>(0), hom_tvec.at<double>(1), hom_tvec.at<double>(2)));
-                    
-                    // transform rvec
-                    Mat rvec = vec_to_Mat ({it2->rvec[0], it2->rvec[1], it2->rvec[2]}, COL_VEC);
-                    Mat_<double> rmat(3,3);
-                    Rodrigues (rvec, rmat); // rmat * camera_coord_vec = marker_ccord_vec
-                                            // => ground_coord_vec = transformationMatrix3x3 * camera_coord_vec
-                                            //                    = transformationMatrix3x3 * inv(rmat) * marker_ccord_vec
-                    Mat headvec = transformationMatrix3x3[it2->camid] * rmat.inv() * vec_to_Mat ({1.0,0.0,0.0}, COL_VEC);
-                    headvecs.push_back (Vec3d (headvec.at<double>(0), headvec.at<double>(1), headvec.at<double>(2)));
-                    
-                    ++count;
-                }
-            
-            if (count > 0) {
-                calcCovarMatrix (vectorVec3d_to_mat (headvecs), marker_headvec_cov, marker_mean_headvec, 
-                                CV_COVAR_NORMAL|CV_COVAR_ROWS);
-                calcCovarMatrix (vectorVec3d_to_mat (tvecs), marker_tvec_cov, marker_mean_tvec, 
-                                CV_COVAR_NORMAL|CV_COVAR_ROWS);
-                double heading_degrees = atan2(marker_mean_headvec.at<double>(1),marker_mean_headvec.at<double>(0)) * 180.0 / PI;
-                
-                // print
-                cout << "Marker " << it->first << " in ground coordinates:\n\ttvec = " << marker_mean_tvec << "\n\theadvec = " << marker_mean_headvec << " (heading = " << heading_degrees << " degrees)" << endl;
-            }
+            string label = "Marker " + to_string(it->first);
+            for (int a=0; a<triangulated.size(); ++a)
+                if (triangulated[a].id == it->first)
+                    label += " (triangulated from " + to_string(triangulated[a].nViews) + " cameras, corner rms = "
+                             + to_string(triangulated[a].rmsError) + ")";
+            print_ground_pose (label, it->second, transformationMatrix, transformationMatrix3x3,
+                               max_queue_size, max_pose_age, poseLog.is_open() ? &roundRecords : 0, it->first);
+        }
+        for (int b=0; b<bodies.size(); ++b) {   // bodies are logged as id -1-b
+            auto it = body_pose.find (bodies[b].name);
+            if (it != body_pose.end())
+                print_ground_pose ("Body " + it->first, it->second, transformationMatrix, transformationMatrix3x3,
+                                   max_queue_size, max_pose_age, poseLog.is_open() ? &roundRecords : 0, -1-b);
+        }
+        // log in capture time order; an average without a reading newer than its last record is not logged again
+        sort (roundRecords.begin(), roundRecords.end(),
+              [] (const PoseRecord& r1, const PoseRecord& r2) { return (r1.timestamp < r2.timestamp); });
+        for (int a=0; a<roundRecords.size(); ++a) {
+            auto last = lastLogged.find (roundRecords[a].id);
+            if (last != lastLogged.end() && roundRecords[a].timestamp <= last->second) continue;
+            lastLogged[roundRecords[a].id] = roundRecords[a].timestamp;
+            poseLog.append (roundRecords[a]);
         }
+        roundRecords.clear();
         
     }
 
@@ -0,0 +1,500 @@
+/*
+By downloading, copying, installing or using the software you agree to this
+license. If you do not agree to this license, do not download, install,
+copy or use the software.
+
+                          License Agreement
+               For Open Source Computer Vision Library
+                       (3-clause BSD License)
+
+Copyright (C) 2013, OpenCV Foundation, all rights reserved.
+Third party copyrights are property of their respective owners.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+  * Neither the names of the copyright holders nor the names of the contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+This software is provided by the copyright holders and contributors "as is" and
+any express or implied warranties, including, but not limited to, the implied
+warranties of merchantability and fitness for a particular purpose are
+disclaimed. In no event shall copyright holders or contributors be liable for
+any direct, indirect, incidental, special, exemplary, or consequential damages
+(including, but not limited to, procurement of substitute goods or services;
+loss of use, data, or profits; or business interruption) however caused
+and on any theory of liability, whether in contract, strict liability,
+or tort (including negligence or otherwise) arising in any way out of
+the use of this software, even if advised of the possibility of such damage.
+*/
+
+
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/aruco.hpp>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+
+#include "utils/string_utils.hpp"
+#include "utils/marker_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+const char* about =
+        "Tunes marker detector parameters per camera on recorded or synthetic frames.\n"
+        "  Searches for the fastest parameters that still find -minrecall of the reference markers\n"
+        "  with corners within -maxcerr pixels of the reference, and writes them to the output file.\n"
+        "  The reference is the ground truth for -synth frames, otherwise an exhaustive detection.\n";
+const char* keys  =
+        "{@outfile |<none> | Output detector parameter file pattern: /path/to/file_with_[ci].yml. [ci] will be replaced by camera id. }"
+        "{d        |       | dictionary: DICT_4X4_50=0, DICT_4X4_100=1, DICT_4X4_250=2,"
+        "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
+        "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
+        "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16}"
+        "{ci       | 0     | Camera id(s), comma separated e.g. 0,1,2. Frames are captured from the cameras unless -v, -imgs or -synth is given }"
+        "{v        |       | Video file pattern: /path/to/video_[ci].avi. [ci] will be replaced by camera id. }"
+        "{imgs     |       | Image glob pattern: /path/to/frames_[ci]/*.png. [ci] will be replaced by camera id. }"
+        "{synth    | 0     | Number of synthetic frames with known marker corners to tune on }"
+        "{size     | 640x480 | Size of the synthetic frames }"
+        "{dp       |       | Starting detector parameter file pattern (with [ci]); default: OpenCV defaults }"
+        "{nf       | 100   | Maximum number of recorded frames used }"
+        "{minrecall | 0.98 | Minimum fraction of the reference markers that must be found }"
+        "{maxcerr  | 0.5   | Maximum RMS corner error (in pixels) against the reference }"
+        "{passes   | 3     | Maximum number of passes over all parameters }"
+        "{ids      |       | Allowed marker ids, e.g. '0-29,40' (no space), as given to trackmarkers. Tunes the built-in detector that trackmarkers then runs }"
+        "{fd       | false | Tune the built-in single-pass marker detector (trackmarkers -fd; implied by -ids) }";
+}
+
+// ====================================================
+
+/**
+ */
+static bool readDetectorParameters(string filename, aruco::DetectorParameters &params) {
+    FileStorage fs(filename, FileStorage::READ);
+    if(!fs.isOpened())
+        return false;
+    fs["adaptiveThreshWinSizeMin"] >> params.adaptiveThreshWinSizeMin;
+    fs["adaptiveThreshWinSizeMax"] >> params.adaptiveThreshWinSizeMax;
+    fs["adaptiveThreshWinSizeStep"] >> params.adaptiveThreshWinSizeStep;
+    fs["adaptiveThreshConstant"] >> params.adaptiveThreshConstant;
+    fs["minMarkerPerimeterRate"] >> params.minMarkerPerimeterRate;
+    fs["maxMarkerPerimeterRate"] >> params.maxMarkerPerimeterRate;
+    fs["polygonalApproxAccuracyRate"] >> params.polygonalApproxAccuracyRate;
+    fs["minCornerDistanceRate"] >> params.minCornerDistanceRate;
+    fs["minDistanceToBorder"] >> params.minDistanceToBorder;
+    fs["minMarkerDistanceRate"] >> params.minMarkerDistanceRate;
+    fs["doCornerRefinement"] >> params.doCornerRefinement;
+    fs["cornerRefinementWinSize"] >> params.cornerRefinementWinSize;
+    fs["cornerRefinementMaxIterations"] >> params.cornerRefinementMaxIterations;
+    fs["cornerRefinementMinAccuracy"] >> params.cornerRefinementMinAccuracy;
+    fs["markerBorderBits"] >> params.markerBorderBits;
+    fs["perspectiveRemovePixelPerCell"] >> params.perspectiveRemovePixelPerCell;
+    fs["perspectiveRemoveIgnoredMarginPerCell"] >> params.perspectiveRemoveIgnoredMarginPerCell;
+    fs["maxErroneousBitsInBorderRate"] >> params.maxErroneousBitsInBorderRate;
+    fs["minOtsuStdDev"] >> params.minOtsuStdDev;
+    fs["errorCorrectionRate"] >> params.errorCorrectionRate;
+    return true;
+}
+
+/**
+ */
+static bool writeDetectorParameters(string filename, const aruco::DetectorParameters &params) {
+    FileStorage fs(filename, FileStorage::WRITE);
+    if(!fs.isOpened())
+        return false;
+    fs << "adaptiveThreshWinSizeMin" << params.adaptiveThreshWinSizeMin;
+    fs << "adaptiveThreshWinSizeMax" << params.adaptiveThreshWinSizeMax;
+    fs << "adaptiveThreshWinSizeStep" << params.adaptiveThreshWinSizeStep;
+    fs << "adaptiveThreshConstant" << params.adaptiveThreshConstant;
+    fs << "minMarkerPerimeterRate" << params.minMarkerPerimeterRate;
+    fs << "maxMarkerPerimeterRate" << params.maxMarkerPerimeterRate;
+    fs << "polygonalApproxAccuracyRate" << params.polygonalApproxAccuracyRate;
+    fs << "minCornerDistanceRate" << params.minCornerDistanceRate;
+    fs << "minDistanceToBorder" << params.minDistanceToBorder;
+    fs << "minMarkerDistanceRate" << params.minMarkerDistanceRate;
+    fs << "doCornerRefinement" << (int)params.doCornerRefinement;
+    fs << "cornerRefinementWinSize" << params.cornerRefinementWinSize;
+    fs << "cornerRefinementMaxIterations" << params.cornerRefinementMaxIterations;
+    fs << "cornerRefinementMinAccuracy" << params.cornerRefinementMinAccuracy;
+    fs << "markerBorderBits" << params.markerBorderBits;
+    fs << "perspectiveRemovePixelPerCell" << params.perspectiveRemovePixelPerCell;
+    fs << "perspectiveRemoveIgnoredMarginPerCell" << params.perspectiveRemoveIgnoredMarginPerCell;
+    fs << "maxErroneousBitsInBorderRate" << params.maxErroneousBitsInBorderRate;
+    fs << "minOtsuStdDev" << params.minOtsuStdDev;
+    fs << "errorCorrectionRate" << params.errorCorrectionRate;
+    return true;
+}
+
+// ====================================================
+
+// A frame with the markers that should be found in it.
+struct TuningFrame {
+    Mat image;
+    vector< int > ids;
+    vector< vector< Point2f > > corners;
+};
+
+// Parameters searched, with the values tried for each.
+struct Knob {
+    const char* name;
+    vector<double> values;
+};
+
+static const vector<Knob> knobs = {
+    { "adaptiveThreshWinSizeMin",      {3, 5, 7, 11} },
+    { "adaptiveThreshWinSizeMax",      {7, 11, 15, 23, 33, 53} },
+    { "adaptiveThreshWinSizeStep",     {2, 4, 6, 10, 20} },
+    { "adaptiveThreshConstant",        {5, 7, 9} },
+    { "minMarkerPerimeterRate",        {0.01, 0.02, 0.03, 0.05, 0.08} },
+    { "maxMarkerPerimeterRate",        {1, 2, 4} },
+    { "polygonalApproxAccuracyRate",   {0.03, 0.05, 0.08} },
+    { "perspectiveRemovePixelPerCell", {2, 3, 4, 6, 8} },
+    { "perspectiveRemoveIgnoredMarginPerCell", {0.13, 0.2, 0.3} },
+    { "doCornerRefinement",            {0, 1} },
+    { "cornerRefinementWinSize",       {3, 5, 7} },
+    { "cornerRefinementMaxIterations", {10, 30} }
+};
+
+static double get_knob (const aruco::DetectorParameters& p, int k) {
+    switch (k) {
+        case 0: return p.adaptiveThreshWinSizeMin;
+        case 1: return p.adaptiveThreshWinSizeMax;
+        case 2: return p.adaptiveThreshWinSizeStep;
+        case 3: return p.adaptiveThreshConstant;
+        case 4: return p.minMarkerPerimeterRate;
+        case 5: return p.maxMarkerPerimeterRate;
+        case 6: return p.polygonalApproxAccuracyRate;
+        case 7: return p.perspectiveRemovePixelPerCell;
+        case 8: return p.perspectiveRemoveIgnoredMarginPerCell;
+        case 9: return p.doCornerRefinement ? 1 : 0;
+        case 10: return p.cornerRefinementWinSize;
+        default: return p.cornerRefinementMaxIterations;
+    }
+}
+
+static void set_knob (aruco::DetectorParameters& p, int k, double v) {
+    switch (k) {
+        case 0: p.adaptiveThreshWinSizeMin = (int)v; break;
+        case 1: p.adaptiveThreshWinSizeMax = (int)v; break;
+        case 2: p.adaptiveThreshWinSizeStep = (int)v; break;
+        case 3: p.adaptiveThreshConstant = v; break;
+        case 4: p.minMarkerPerimeterRate = v; break;
+        case 5: p.maxMarkerPerimeterRate = v; break;
+        case 6: p.polygonalApproxAccuracyRate = v; break;
+        case 7: p.perspectiveRemovePixelPerCell = (int)v; break;
+        case 8: p.perspectiveRemoveIgnoredMarginPerCell = v; break;
+        case 9: p.doCornerRefinement = v != 0; break;
+        case 10: p.cornerRefinementWinSize = (int)v; break;
+        default: p.cornerRefinementMaxIterations = (int)v; break;
+    }
+}
+
+// ====================================================
+
+struct Evaluation {
+    aruco::DetectorParameters params;
+    double msPerFrame, recall, cornerError;
+    bool feasible;
+};
+
+// Detector being tuned: the built-in MarkerDetector (with the allowed ids) or aruco::detectMarkers,
+// whichever trackmarkers will run with the same options.
+struct DetectorChoice {
+    bool builtIn;
+    vector<int> allowedIds;
+};
+
+/**
+ * Detects markers in all frames with the given parameters: time per frame, fraction of the
+ * reference markers found, and RMS distance of their corners from the reference corners.
+ */
+Evaluation evaluate (const vector<TuningFrame>& frames, const aruco::Dictionary& dictionary, const DetectorChoice& detector,
+                     const aruco::DetectorParameters& params, double minRecall, double maxCornerError) {
+    Evaluation e;
+    e.params = params;
+    MarkerDetector markerDetector;
+    if (detector.builtIn)
+        markerDetector = MarkerDetector (dictionary, params, detector.allowedIds);
+    DetectionResult det;
+    vector< int >& ids = det.ids;
+    vector< vector< Point2f > >& corners = det.corners;
+    int nRef = 0, nFound = 0, nCorners = 0;
+    double sqErr = 0.0, seconds = 0.0;
+    for (int f=0; f<frames.size(); ++f) {
+        double tick = (double)getTickCount();
+        if (detector.builtIn)
+            markerDetector.detect (frames[f].image, det);
+        else
+            aruco::detectMarkers (frames[f].image, dictionary, corners, ids, params);
+        seconds += ((double)getTickCount() - tick) / getTickFrequency();
+
+        nRef += frames[f].ids.size();
+        for (int r=0; r<frames[f].ids.size(); ++r)
+            for (int i=0; i<ids.size(); ++i) {
+                if (ids[i] != frames[f].ids[r]) continue;
+                double d2 = 0.0;
+                for (int j=0; j<4; ++j) {
+                    Point2f d = corners[i][j] - frames[f].corners[r][j];
+                    d2 += d.dot(d);
+                }
+                if (d2 > 4 * 25.0) continue;  // same id elsewhere in the image
+                ++nFound;
+                sqErr += d2;
+                nCorners += 4;
+                break;
+            }
+    }
+    e.msPerFrame = frames.empty() ? 0.0 : 1000.0 * seconds / frames.size();
+    e.recall = nRef > 0 ? (double)nFound / nRef : 1.0;
+    e.cornerError = nCorners > 0 ? sqrt (sqErr / nCorners) : 0.0;
+    e.feasible = e.recall >= minRecall && e.cornerError <= maxCornerError;
+    return (e);
+}
+
+// Feasible beats infeasible; feasible ones compare by time (2% margin against timing noise),
+// infeasible ones by recall, then corner error.
+bool better (const Evaluation& a, const Evaluation& b) {
+    if (a.feasible != b.feasible) return (a.feasible);
+    if (a.feasible) return (a.msPerFrame < 0.98 * b.msPerFrame);
+    if (a.recall != b.recall) return (a.recall > b.recall);
+    return (a.cornerError < b.cornerError);
+}
+
+void print_evaluation (const string& label, const Evaluation& e) {
+    cout << label << ": " << e.msPerFrame << " ms/frame, recall " << e.recall * 100 << " %, corner error "
+         << e.cornerError << " px" << (e.feasible ? "" : " (below the floor)") << endl;
+}
+
+/**
+ * Coordinate descent over the knobs: each value of each parameter is tried with the others
+ * fixed, and kept if it is better; repeated until a pass brings no improvement.
+ */
+Evaluation tune (const vector<TuningFrame>& frames, const aruco::Dictionary& dictionary, const DetectorChoice& detector,
+                 const aruco::DetectorParameters& start, double minRecall, double maxCornerError, int maxPasses) {
+    Evaluation best = evaluate (frames, dictionary, detector, start, minRecall, maxCornerError);
+    print_evaluation ("Starting parameters", best);
+    for (int pass=0; pass<maxPasses; ++pass) {
+        bool improved = false;
+        for (int k=0; k<knobs.size(); ++k) {
+            double current = get_knob (best.params, k);
+            for (int v=0; v<knobs[k].values.size(); ++v) {
+                if (knobs[k].values[v] == current) continue;
+                aruco::DetectorParameters params = best.params;
+                set_knob (params, k, knobs[k].values[v]);
+                if (params.adaptiveThreshWinSizeMax < params.adaptiveThreshWinSizeMin) continue;
+                Evaluation e = evaluate (frames, dictionary, detector, params, minRecall, maxCornerError);
+                if (better (e, best)) {
+                    best = e;
+                    improved = true;
+                    cout << "  " << knobs[k].name << " = " << knobs[k].values[v] << ": ";
+                    print_evaluation ("", best);
+                }
+            }
+        }
+        if (!improved) break;
+    }
+    return (best);
+}
+
+// ====================================================
+
+/**
+ * Synthetic frame: markers of random ids (from allowedIds if not empty) under random perspective
+ * on a textured background, one per cell of a 3x2 grid, with random contrast, blur and noise.
+ * The corners are exact.
+ */
+void make_synthetic_frame (const aruco::Dictionary& dictionary, const vector<int>& allowedIds, Size size, RNG& rng,
+                           TuningFrame& frame) {
+    Mat background (size.height/8 + 1, size.width/8 + 1, CV_8UC1);
+    rng.fill (background, RNG::UNIFORM, 60, 200);
+    resize (background, frame.image, size, 0, 0, INTER_CUBIC);
+    frame.ids.clear();
+    frame.corners.clear();
+
+    int cellW = size.width / 3, cellH = size.height / 2;
+    for (int cell=0; cell<6; ++cell) {
+        if (rng.uniform (0.0, 1.0) < 0.3) continue;
+        int id = allowedIds.empty() ? rng.uniform (0, dictionary.bytesList.rows)
+                                    : allowedIds[rng.uniform (0, (int)allowedIds.size())];
+        Mat marker, patch (140, 140, CV_8UC1, Scalar::all(255));   // 100 px marker with a white quiet zone
+        aruco::drawMarker (dictionary, id, 100, marker);
+        marker.copyTo (patch (Rect (20, 20, 100, 100)));
+
+        // the warped patch stays within its cell (corner radius <= side * 0.7 * 1.4 * 1.15 < half the
+        // cell), so no quiet zone is drawn over a neighbouring marker
+        double side = rng.uniform (0.15, 0.44) * min (cellW, cellH);
+        Point2f center ((float)(cell % 3 * cellW + cellW / 2.0), (float)(cell / 3 * cellH + cellH / 2.0));
+        double angle = rng.uniform (0.0, 2 * CV_PI);
+        vector< Point2f > src (4), dst (4);
+        for (int j=0; j<4; ++j) {
+            src[j] = Point2f (j == 1 || j == 2 ? 140.f : 0.f, j >= 2 ? 140.f : 0.f);
+            double a = angle + j * CV_PI / 2, r = side * 0.7 * 140 / 100 * rng.uniform (0.85, 1.15);
+            dst[j] = center + Point2f ((float)(r * cos (a)), (float)(r * sin (a)));
+        }
+        Mat H = getPerspectiveTransform (src, dst);
+        warpPerspective (patch, frame.image, H, size, INTER_LINEAR, BORDER_TRANSPARENT);
+
+        // black square edges lie half a pixel outside the outermost pixel centres
+        vector< Point2f > markerCorners = { Point2f (19.5f, 19.5f), Point2f (119.5f, 19.5f),
+                                            Point2f (119.5f, 119.5f), Point2f (19.5f, 119.5f) }, imageCorners;
+        perspectiveTransform (markerCorners, imageCorners, H);
+        frame.ids.push_back (id);
+        frame.corners.push_back (imageCorners);
+    }
+
+    frame.image.convertTo (frame.image, -1, rng.uniform (0.5, 1.2), rng.uniform (-30.0, 30.0));
+    double sigma = rng.uniform (0.0, 1.5);
+    if (sigma > 0.3) GaussianBlur (frame.image, frame.image, Size(), sigma);
+    Mat noise (size, CV_16SC1);
+    rng.fill (noise, RNG::NORMAL, 0, rng.uniform (0.0, 8.0));
+    Mat noisy;
+    frame.image.convertTo (noisy, CV_16SC1);
+    noisy += noise;
+    noisy.convertTo (frame.image, CV_8UC1);
+}
+
+// Reads up to maxFrames gray frames of a video, a camera or a list of image files.
+bool read_frames (VideoCapture& input, const vector<String>& imageFiles, int maxFrames, vector<TuningFrame>& frames) {
+    Mat image;
+    for (int f=0; f<maxFrames; ++f) {
+        if (!imageFiles.empty()) {
+            if (f >= imageFiles.size()) break;
+            image = imread (imageFiles[f], IMREAD_GRAYSCALE);
+        }
+        else {
+            if (!input.read (image)) break;
+            cvtColor (image, image, COLOR_BGR2GRAY);
+        }
+        if (image.empty()) return (false);
+        frames.push_back (TuningFrame());
+        image.copyTo (frames.back().image);
+    }
+    return (!frames.empty());
+}
+
+// Reference markers of recorded frames: dense threshold windows, small markers, refined corners.
+// Only allowed ids are kept (all if allowedIds is empty).
+void detect_reference (const aruco::Dictionary& dictionary, const vector<int>& allowedIds, const aruco::DetectorParameters& start,
+                       vector<TuningFrame>& frames) {
+    aruco::DetectorParameters ref = start;
+    ref.adaptiveThreshWinSizeMin = 3;
+    ref.adaptiveThreshWinSizeMax = 53;
+    ref.adaptiveThreshWinSizeStep = 4;
+    ref.minMarkerPerimeterRate = min (ref.minMarkerPerimeterRate, 0.01);
+    ref.doCornerRefinement = true;
+    ref.cornerRefinementMaxIterations = 50;
+    ref.cornerRefinementMinAccuracy = 0.01;
+    for (int f=0; f<frames.size(); ++f) {
+        TuningFrame& fr = frames[f];
+        aruco::detectMarkers (fr.image, dictionary, fr.corners, fr.ids, ref);
+        if (allowedIds.empty()) continue;
+        int kept = 0;
+        for (int i=0; i<fr.ids.size(); ++i)
+            if (find (allowedIds.begin(), allowedIds.end(), fr.ids[i]) != allowedIds.end()) {
+                fr.ids[kept] = fr.ids[i];
+                fr.corners[kept] = fr.corners[i];
+                ++kept;
+            }
+        fr.ids.resize (kept);
+        fr.corners.resize (kept);
+    }
+}
+
+// ====================================================
+
+int main(int argc, char *argv[]) {
+    CommandLineParser parser(argc, argv, keys);
+    parser.about(about);
+
+    if(argc < 3) {
+        parser.printMessage();
+        return 0;
+    }
+
+    int dictionaryId = parser.get<int>("d");
+    vector<int> camIds = parse_id_list(parser.get<string>("ci"));
+    int nSynth = parser.get<int>("synth");
+    int maxFrames = parser.get<int>("nf");
+    double minRecall = parser.get<double>("minrecall");
+    double maxCornerError = parser.get<double>("maxcerr");
+    int maxPasses = parser.get<int>("passes");
+    string outfile = parser.get<string>(0);
+    DetectorChoice detector;
+    detector.builtIn = parser.has("ids") || parser.get<bool>("fd");
+    if (parser.has("ids")) detector.allowedIds = parse_id_list(parser.get<string>("ids"));
+
+    if(!parser.check()) {
+        parser.printErrors();
+        return 0;
+    }
+
+    aruco::Dictionary dictionary =
+        aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
+
+    for (int c=0; c<camIds.size(); ++c) {
+        int camId = camIds[c];
+        unordered_map<string,string> fname_replacements = { {"[ci]", to_string(camId)} };
+
+        aruco::DetectorParameters start;
+        if(parser.has("dp")) {
+            bool readOk = readDetectorParameters(multi_replace(parser.get<string>("dp"), fname_replacements), start);
+            if(!readOk) {
+                cerr << "Invalid detector parameters file for camera " << camId << endl;
+                return 1;
+            }
+        }
+
+        // dataset
+        vector<TuningFrame> frames;
+        if(nSynth > 0) {
+            Size size;
+            sscanf(parser.get<string>("size").c_str(), "%dx%d", &size.width, &size.height);
+            RNG rng(camId + 1);
+            frames.resize(nSynth);
+            for (int f=0; f<nSynth; ++f)
+                make_synthetic_frame(dictionary, detector.allowedIds, size, rng, frames[f]);
+        }
+        else {
+            VideoCapture input;
+            vector<String> imageFiles;
+            if(parser.has("imgs"))
+                glob(multi_replace(parser.get<string>("imgs"), fname_replacements), imageFiles);
+            else if(parser.has("v"))
+                input.open(multi_replace(parser.get<string>("v"), fname_replacements));
+            else
+                input.open(camId);
+            if(!read_frames(input, imageFiles, maxFrames, frames)) {
+                cerr << "No frames for camera " << camId << endl;
+                return 1;
+            }
+            detect_reference(dictionary, detector.allowedIds, start, frames);
+        }
+
+        cout << "Camera " << camId << ": tuning " << (detector.builtIn ? "the built-in detector" : "aruco::detectMarkers")
+             << " on " << frames.size() << " frames" << endl;
+        Evaluation best = tune(frames, dictionary, detector, start, minRecall, maxCornerError, maxPasses);
+        print_evaluation("Tuned parameters", best);
+        if(!best.feasible)
+            cerr << "Camera " << camId << ": no parameters reach the recall / corner error floor" << endl;
+
+        string filename = multi_replace(outfile, fname_replacements);
+        if(!writeDetectorParameters(filename, best.params)) {
+            cerr << "Could not write " << filename << endl;
+            return 1;
+        }
+        cout << "Detector parameters saved to " << filename << endl;
+    }
+
+    return 0;
+}
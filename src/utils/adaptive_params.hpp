@@ -0,0 +1,108 @@
+#ifndef ADAPTIVE_PARAMS_HPP__
+#define ADAPTIVE_PARAMS_HPP__
+
+#include <opencv2/aruco.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "marker_detector.hpp"
+
+/**
+ * Online narrowing of a MarkerDetector's search for one camera. Frames detected with the full
+ * settings (every probeEvery frames, and right after a marker was lost) show which threshold
+ * windows and which marker perimeters actually produce markers; the frames in between only
+ * threshold with those windows and only accept contours in that perimeter range (with some
+ * slack). With no markers in sight the full settings are kept.
+ * The perimeter rates are relative to the size of the detected image, so the search is only
+ * narrowed on whole frames; region crops and downscaled passes run with the full settings.
+ */
+class AdaptiveDetectorParams {
+public:
+    AdaptiveDetectorParams () : probeEvery(30), frame(0), fullNext(true), narrowedFrame(false), wholeFrame(true),
+                                lastCount(0), minRate(0.0), maxRate(0.0) { }
+
+    AdaptiveDetectorParams (const cv::aruco::DetectorParameters& fullParams, int probeEvery_=30)
+            : full(fullParams), probeEvery(probeEvery_), frame(0), fullNext(true), narrowedFrame(false), wholeFrame(true),
+              lastCount(0), minRate(0.0), maxRate(0.0) {
+        threshold_windows (full, fullWindows);
+        score.assign (fullWindows.size(), 0.0);
+    }
+
+    // Sets up the detector for the next frame; whole_: the detector runs on the whole frame at full size.
+    void prepare (MarkerDetector& detector, bool whole_=true) {
+        detector.params = full;
+        detector.windowSizes.clear();
+        wholeFrame = whole_;
+        narrowedFrame = false;
+        if (!wholeFrame) return;
+        narrowedFrame = !fullNext && frame % probeEvery != 0 && maxRate > 0.0;
+        ++frame;
+        if (!narrowedFrame) return;
+        for (int w=0; w<fullWindows.size(); ++w)
+            if (score[w] >= minScore) detector.windowSizes.push_back (fullWindows[w]);
+        if (detector.windowSizes.empty()) {
+            narrowedFrame = false;
+            return;
+        }
+        detector.params.minMarkerPerimeterRate = std::max (full.minMarkerPerimeterRate, minRate / rateSlack);
+        detector.params.maxMarkerPerimeterRate = std::min (full.maxMarkerPerimeterRate, maxRate * rateSlack);
+    }
+
+    // Learns from the markers (ids) the detector found in the frame set up by prepare(). Partial
+    // frames ran with the full settings, so they can neither lose markers to narrowing nor teach
+    // perimeter rates of the whole frame.
+    void update (const MarkerDetector& detector, const std::vector<int>& ids) {
+        if (!wholeFrame) return;
+        fullNext = narrowedFrame && ids.size() < lastCount;   // a marker was lost: check with the full settings
+        lastCount = ids.size();
+        if (narrowedFrame) {
+            for (int a=0; a<ids.size(); ++a) {
+                minRate = std::min (minRate, detector.markerPerimeterRates[a]);
+                maxRate = std::max (maxRate, detector.markerPerimeterRates[a]);
+            }
+            return;
+        }
+
+        // full settings: every window is tried, so the scores can be updated
+        for (int w=0; w<fullWindows.size(); ++w) {
+            bool hit = std::find (detector.markerWindows.begin(), detector.markerWindows.end(), fullWindows[w])
+                       != detector.markerWindows.end();
+            score[w] = 0.7 * score[w] + (hit ? 0.3 : 0.0);
+        }
+        minRate = maxRate = 0.0;
+        for (int a=0; a<ids.size(); ++a) {
+            double r = detector.markerPerimeterRates[a];
+            minRate = a == 0 ? r : std::min (minRate, r);
+            maxRate = std::max (maxRate, r);
+        }
+    }
+
+    // e.g. "windows 13,23, perimeter 0.05-0.4" or "full"
+    std::string describe () const {
+        if (!narrowedFrame) return ("full");
+        std::string desc = "windows ";
+        bool first = true;
+        for (int w=0; w<fullWindows.size(); ++w)
+            if (score[w] >= minScore) {
+                desc += (first ? "" : ",") + std::to_string (fullWindows[w]);
+                first = false;
+            }
+        return (desc + ", perimeter " + std::to_string (std::max (full.minMarkerPerimeterRate, minRate / rateSlack)).substr (0, 5)
+                + "-" + std::to_string (std::min (full.maxMarkerPerimeterRate, maxRate * rateSlack)).substr (0, 5));
+    }
+
+private:
+    static constexpr double minScore = 0.05, rateSlack = 1.5;
+
+    cv::aruco::DetectorParameters full;
+    std::vector<int> fullWindows;
+    std::vector<double> score;    // decaying rate at which each window produced markers on full frames
+    int probeEvery;
+    long frame;
+    bool fullNext, narrowedFrame, wholeFrame;
+    size_t lastCount;
+    double minRate, maxRate;      // perimeter range of the markers seen lately
+};
+
+#endif
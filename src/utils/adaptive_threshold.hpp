@@ -0,0 +1,150 @@
+#ifndef ADAPTIVE_THRESHOLD_HPP__
+#define ADAPTIVE_THRESHOLD_HPP__
+
+#include <opencv2/imgproc.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+// The SIMD variants are compiled with function target attributes and picked at run time, so the
+// binaries need no -march flag. Build with -DMOCAP_NO_AVX2 to use SSE2 at most, or with
+// -DMOCAP_NO_SIMD for the scalar code alone.
+#if !defined(MOCAP_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MOCAP_THRESH_X86
+#endif
+
+// One output row of a mean adaptive threshold (THRESH_BINARY_INV), given pointers to the
+// four integral-image corners of each pixel's window, from column x on.
+// The window mean rounds to >= src+idelta iff 2*sum >= (2*(src+idelta)-1)*area, so with
+// k1 = 2*area and k0 = (2*idelta-1)*area the test is exact in integers: 2*sum - k0 >= k1*src.
+void adaptive_threshold_row_scalar (const uchar* src, const int* tl, const int* tr, const int* bl, const int* br,
+                                    int k1, int k0, uchar* dst, int x, int n) {
+    for (; x < n; ++x) {
+        int s = br[x] - tr[x] - bl[x] + tl[x];
+        dst[x] = (2*s - k0 >= k1*src[x]) ? 255 : 0;
+    }
+}
+
+#if defined(MOCAP_THRESH_X86)
+__attribute__((target("avx2")))
+void adaptive_threshold_row_avx2 (const uchar* src, const int* tl, const int* tr, const int* bl, const int* br,
+                                  int k1, int k0, uchar* dst, int n) {
+    int x = 0;
+    __m256i vk1 = _mm256_set1_epi32 (k1), vk0 = _mm256_set1_epi32 (k0);
+    for (; x <= n-16; x += 16) {
+        __m256i m[2];
+        for (int h=0; h<2; ++h) {
+            int o = x + 8*h;
+            __m256i s = _mm256_sub_epi32 (_mm256_loadu_si256 ((const __m256i*)(br+o)), _mm256_loadu_si256 ((const __m256i*)(tr+o)));
+            s = _mm256_add_epi32 (s, _mm256_sub_epi32 (_mm256_loadu_si256 ((const __m256i*)(tl+o)), _mm256_loadu_si256 ((const __m256i*)(bl+o))));
+            __m256i v = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i*)(src+o)));
+            __m256i lhs = _mm256_sub_epi32 (_mm256_add_epi32 (s, s), vk0);
+            __m256i rhs = _mm256_mullo_epi32 (vk1, v);
+            // lhs >= rhs  <=>  !(rhs > lhs)
+            m[h] = _mm256_xor_si256 (_mm256_cmpgt_epi32 (rhs, lhs), _mm256_set1_epi32 (-1));
+        }
+        __m256i w = _mm256_permute4x64_epi64 (_mm256_packs_epi32 (m[0], m[1]), 0xD8);
+        __m256i b = _mm256_permute4x64_epi64 (_mm256_packs_epi16 (w, w), 0xD8);
+        _mm_storeu_si128 ((__m128i*)(dst+x), _mm256_castsi256_si128 (b));
+    }
+    adaptive_threshold_row_scalar (src, tl, tr, bl, br, k1, k0, dst, x, n);
+}
+
+// SSE2 has no 32-bit multiply, so this compares in float; the caller makes sure every operand
+// (at most 255*k1 + |k0|) is below 2^24, where float arithmetic is exact.
+__attribute__((target("sse2")))
+void adaptive_threshold_row_sse2 (const uchar* src, const int* tl, const int* tr, const int* bl, const int* br,
+                                  int k1, int k0, uchar* dst, int n) {
+    int x = 0;
+    __m128 vk1 = _mm_set1_ps ((float)k1), vk0 = _mm_set1_ps ((float)k0);
+    __m128i zero = _mm_setzero_si128 ();
+    for (; x <= n-8; x += 8) {
+        __m128i v16 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i*)(src+x)), zero);
+        __m128i m[2];
+        for (int h=0; h<2; ++h) {
+            int o = x + 4*h;
+            __m128i s = _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i*)(br+o)), _mm_loadu_si128 ((const __m128i*)(tr+o)));
+            s = _mm_add_epi32 (s, _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i*)(tl+o)), _mm_loadu_si128 ((const __m128i*)(bl+o))));
+            __m128i v = h==0 ? _mm_unpacklo_epi16 (v16, zero) : _mm_unpackhi_epi16 (v16, zero);
+            __m128 lhs = _mm_sub_ps (_mm_cvtepi32_ps (_mm_add_epi32 (s, s)), vk0);
+            __m128 rhs = _mm_mul_ps (vk1, _mm_cvtepi32_ps (v));
+            m[h] = _mm_castps_si128 (_mm_cmpge_ps (lhs, rhs));
+        }
+        __m128i w = _mm_packs_epi32 (m[0], m[1]);
+        _mm_storel_epi64 ((__m128i*)(dst+x), _mm_packs_epi16 (w, w));
+    }
+    adaptive_threshold_row_scalar (src, tl, tr, bl, br, k1, k0, dst, x, n);
+}
+#endif
+
+// Dispatches to the widest variant the CPU supports (AVX2, then SSE2 while the float comparison
+// is exact, i.e. for windows up to about 128 pixels), or to the scalar code.
+void adaptive_threshold_row (const uchar* src, const int* tl, const int* tr, const int* bl, const int* br,
+                             int k1, int k0, uchar* dst, int n) {
+#if defined(MOCAP_THRESH_X86)
+#if !defined(MOCAP_NO_AVX2)
+    static const bool hasAvx2 = __builtin_cpu_supports ("avx2");
+    if (hasAvx2) {
+        adaptive_threshold_row_avx2 (src, tl, tr, bl, br, k1, k0, dst, n);
+        return;
+    }
+#endif
+    static const bool hasSse2 = __builtin_cpu_supports ("sse2");
+    if (hasSse2 && 255.0 * k1 + std::abs (k0) < 16777216.0) {
+        adaptive_threshold_row_sse2 (src, tl, tr, bl, br, k1, k0, dst, n);
+        return;
+    }
+#endif
+    adaptive_threshold_row_scalar (src, tl, tr, bl, br, k1, k0, dst, 0, n);
+}
+
+// ================================================
+
+/**
+ * Computes cv::adaptiveThreshold (src, dst[k], 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV,
+ * winSizes[k], C) for all window sizes from a single integral image, in one pass over the rows.
+ * The padded copy and the integral image are kept between calls. The integral image is CV_32S,
+ * which holds 255 * pixels below 2^31, i.e. padded images up to about 8.4 Mpixel: a 3840x2160
+ * frame only fits with a window radius up to 10. Larger images fall back to cv::adaptiveThreshold
+ * once per window size.
+ */
+class MultiWindowThreshold {
+public:
+    void apply (const cv::Mat& src, const std::vector<int>& winSizes, double C, std::vector<cv::Mat>& dst) {
+        int maxRadius = 0;
+        for (int k=0; k<winSizes.size(); ++k)
+            maxRadius = std::max (maxRadius, winSizes[k]/2);
+
+        dst.resize (winSizes.size());
+        if (255.0 * (src.rows + 2*maxRadius) * (src.cols + 2*maxRadius) >= 2147483648.0) {   // CV_32S sums would overflow
+            for (int k=0; k<winSizes.size(); ++k)
+                cv::adaptiveThreshold (src, dst[k], 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, winSizes[k], C);
+            return;
+        }
+
+        // replicated border, like the box filter inside cv::adaptiveThreshold
+        cv::copyMakeBorder (src, padded, maxRadius, maxRadius, maxRadius, maxRadius, cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+        cv::integral (padded, sum, CV_32S);
+
+        for (int k=0; k<winSizes.size(); ++k)
+            dst[k].create (src.size(), CV_8UC1);
+
+        int idelta = cvFloor (C);
+        for (int y=0; y<src.rows; ++y) {
+            const uchar* srcRow = src.ptr<uchar>(y);
+            for (int k=0; k<winSizes.size(); ++k) {
+                int r = winSizes[k]/2, area = winSizes[k]*winSizes[k];
+                const int* top = sum.ptr<int>(y + maxRadius - r) + maxRadius;
+                const int* bottom = sum.ptr<int>(y + maxRadius + r + 1) + maxRadius;
+                adaptive_threshold_row (srcRow, top-r, top+r+1, bottom-r, bottom+r+1,
+                                        2*area, (2*idelta-1)*area, dst[k].ptr<uchar>(y), src.cols);
+            }
+        }
+    }
+
+private:
+    cv::Mat padded, sum;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ALLOC_COUNTER_HPP__
+#define ALLOC_COUNTER_HPP__
+
+// Counts heap allocations made through operator new when compiled with -DMOCAP_COUNT_ALLOCS
+// (e.g. 'make DEFS=-DMOCAP_COUNT_ALLOCS trackmarkers'). Include it from one translation unit only.
+// Buffers that OpenCV allocates with cv::fastMalloc (Mat data) are not seen by this counter.
+
+#ifdef MOCAP_COUNT_ALLOCS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+std::atomic<long> mocap_alloc_count (0);
+
+void* operator new (size_t size) {
+    ++mocap_alloc_count;
+    void* p = malloc (size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return (p);
+}
+void* operator new[] (size_t size) { return (operator new (size)); }
+void operator delete (void* p) noexcept { free (p); }
+void operator delete[] (void* p) noexcept { free (p); }
+void operator delete (void* p, size_t) noexcept { free (p); }
+void operator delete[] (void* p, size_t) noexcept { free (p); }
+
+long allocation_count () { return (mocap_alloc_count.load()); }
+bool allocation_counting () { return (true); }
+
+#else
+
+long allocation_count () { return (0); }
+bool allocation_counting () { return (false); }
+
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef CALIB_FRAME_SELECTOR_HPP__
+#define CALIB_FRAME_SELECTOR_HPP__
+
+#include <opencv2/calib3d.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Chooses calibration frames by what they add: a grid over the image counts the marker
+ * corners seen in each cell, and a histogram counts board poses by tilt, tilt direction and
+ * distance. A frame is worth keeping if its corners fall in sparsely covered cells or its
+ * pose is rare, and the frames for a solve are picked greedily by the same measure.
+ */
+class CalibFrameSelector {
+public:
+    static const int nTiltBins = 5, nDirBins = 4, nDistBins = 3;
+    static const int nPoseBins = nTiltBins * nDirBins * nDistBins;
+
+    CalibFrameSelector () : gridCols(0), gridRows(0), refDistance(0.0) { }
+
+    void init (cv::Size imgSize, int cols=8, int rows=6) {
+        imageSize = imgSize;
+        gridCols = cols;
+        gridRows = rows;
+        cellCount.assign (gridCols*gridRows, 0);
+        poseCount.assign (nPoseBins, 0);
+        frameCells.clear();
+        framePoseBin.clear();
+        refDistance = 0.0;
+    }
+
+    bool empty () const { return (gridCols == 0); }
+
+    // Board distance the distance bins are relative to, e.g. that of the first accepted frame.
+    void set_reference_distance (double d) { refDistance = d; }
+    bool has_reference_distance () const { return (refDistance > 0.0); }
+    int size () const { return ((int)frameCells.size()); }
+
+    // Histogram bin of a board pose (rvec, tvec in the camera frame). Tilt is the angle between
+    // the board normal and the optical axis, in 15 deg steps; distances are relative to the reference
+    // distance (all in the middle bin while there is none).
+    int pose_bin (const cv::Vec3d& rvec, const cv::Vec3d& tvec) const {
+        cv::Matx33d R;
+        cv::Rodrigues (rvec, R);
+        cv::Vec3d n (R(0,2), R(1,2), R(2,2));
+        double tilt = std::acos (std::min (1.0, std::fabs (n[2]))) * 180.0 / CV_PI;
+        int tiltBin = std::min (nTiltBins-1, (int)(tilt / 15.0));
+        int dirBin = 0;
+        if (tiltBin > 0)
+            dirBin = std::fabs(n[0]) > std::fabs(n[1]) ? (n[0] > 0 ? 0 : 1) : (n[1] > 0 ? 2 : 3);
+        double dist = cv::norm (tvec);
+        double r = refDistance > 0.0 && dist > 0.0 ? std::log (dist / refDistance) / std::log (2.0) : 0.0;
+        int distBin = r < -0.4 ? 0 : (r > 0.4 ? 2 : 1);
+        return ((tiltBin*nDirBins + dirBin)*nDistBins + distBin);
+    }
+
+    // Information a frame would add to what has been accepted so far (poseBin < 0 if unknown).
+    double information_gain (const std::vector< std::vector<cv::Point2f> >& corners, int poseBin) const {
+        corner_cells (corners, cellsBuf);
+        return (gain (cellsBuf, poseBin, cellCount, poseCount));
+    }
+
+    void add_frame (const std::vector< std::vector<cv::Point2f> >& corners, int poseBin) {
+        frameCells.push_back (std::vector<int>());
+        corner_cells (corners, frameCells.back());
+        framePoseBin.push_back (poseBin);
+        for (int a=0; a<frameCells.back().size(); ++a)
+            ++cellCount[frameCells.back()[a]];
+        if (poseBin >= 0) ++poseCount[poseBin];
+    }
+
+    // Replaces the pose of an accepted frame, e.g. with the one found by a calibration.
+    void set_pose_bin (int frameIdx, int poseBin) {
+        if (framePoseBin[frameIdx] >= 0) --poseCount[framePoseBin[frameIdx]];
+        framePoseBin[frameIdx] = poseBin;
+        if (poseBin >= 0) ++poseCount[poseBin];
+    }
+
+    // Greedily picks up to maxFrames frames that together cover the image and the poses best.
+    // Returns their indices in the order they were added.
+    std::vector<int> select (int maxFrames) const {
+        int n = size();
+        std::vector<int> chosen;
+        if (n <= maxFrames) {
+            for (int a=0; a<n; ++a) chosen.push_back (a);
+            return (chosen);
+        }
+        std::vector<int> cells (cellCount.size(), 0), poses (nPoseBins, 0);
+        std::vector<bool> used (n, false);
+        for (int k=0; k<maxFrames; ++k) {
+            int best = -1;
+            double bestGain = -1.0;
+            for (int a=n-1; a>=0; --a) {  // newest first, so ties go to newer frames
+                if (used[a]) continue;
+                double g = gain (frameCells[a], framePoseBin[a], cells, poses);
+                if (g > bestGain) { bestGain = g; best = a; }
+            }
+            used[best] = true;
+            for (int a=0; a<frameCells[best].size(); ++a)
+                ++cells[frameCells[best][a]];
+            if (framePoseBin[best] >= 0) ++poses[framePoseBin[best]];
+        }
+        for (int a=0; a<n; ++a)
+            if (used[a]) chosen.push_back (a);
+        return (chosen);
+    }
+
+private:
+    cv::Size imageSize;
+    int gridCols, gridRows;
+    double refDistance;
+    std::vector<int> cellCount, poseCount;
+    std::vector< std::vector<int> > frameCells;   // grid cell of every corner of each accepted frame
+    std::vector<int> framePoseBin;
+    mutable std::vector<int> cellsBuf;
+
+    void corner_cells (const std::vector< std::vector<cv::Point2f> >& corners, std::vector<int>& cells) const {
+        cells.clear();
+        for (int a=0; a<corners.size(); ++a)
+            for (int j=0; j<corners[a].size(); ++j) {
+                int cx = std::min (gridCols-1, std::max (0, (int)(corners[a][j].x * gridCols / imageSize.width)));
+                int cy = std::min (gridRows-1, std::max (0, (int)(corners[a][j].y * gridRows / imageSize.height)));
+                cells.push_back (cy*gridCols + cx);
+            }
+    }
+
+    // Mean of 1/(1+count) over the corners' cells, plus 1/(1+count) of the pose bin.
+    static double gain (const std::vector<int>& cells, int poseBin,
+                        const std::vector<int>& cellCnt, const std::vector<int>& poseCnt) {
+        double g = 0.0;
+        for (int a=0; a<cells.size(); ++a)
+            g += 1.0 / (1 + cellCnt[cells[a]]);
+        if (!cells.empty()) g /= cells.size();
+        if (poseBin >= 0) g += 1.0 / (1 + poseCnt[poseBin]);
+        return (g);
+    }
+};
+
+#endif
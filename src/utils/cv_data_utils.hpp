@@ -7,6 +7,7 @@
 #include <iostream>
 #include <unordered_map>
 #include <stdio.h>
+#include <limits>
 
 template <class VV>
 cv::Mat_<double> vectorVec3d_to_mat (VV m) {
@@ -18,4 +19,93 @@ cv::Mat_<double> vectorVec3d_to_mat (VV m) {
     return ret;
 }
 
+// ================================================
+
+/**
+ * Mean and scatter matrix (sum of outer products of the deviations from the mean, i.e. what
+ * calcCovarMatrix gives with CV_COVAR_NORMAL) of a stream of 3-vectors, updated one sample at
+ * a time with Welford's method, so that no samples need to be kept. Convergence tests use the
+ * covariance, scatter/(n-1).
+ */
+class RunningStats3d {
+public:
+    int n;
+    cv::Vec3d mean;
+    cv::Matx33d scatter;
+
+    RunningStats3d () : n(0), mean(0,0,0), scatter(cv::Matx33d::zeros()) { }
+
+    void add (const cv::Vec3d& x) {
+        ++n;
+        cv::Vec3d d = x - mean;
+        mean += d * (1.0/n);
+        cv::Vec3d d2 = x - mean;
+        for (int a=0; a<3; ++a)
+            for (int b=0; b<3; ++b)
+                scatter(a,b) += d[a]*d2[b];
+    }
+
+    // Sample covariance scatter/(n-1), which unlike the scatter matrix does not grow with n.
+    cv::Matx33d covariance () const { return (n > 1 ? scatter * (1.0/(n-1)) : cv::Matx33d::zeros()); }
+
+    // Determinant of the covariance; the largest double while there are fewer than 2 samples.
+    double cov_det () const { return (n > 1 ? cv::determinant (covariance()) : std::numeric_limits<double>::max()); }
+};
+
+// ================================================
+
+/**
+ * Least-squares similarity transform dst = s R src + t between corresponding 3d points
+ * (Umeyama's method; Kabsch's when withScale is false, i.e. s = 1), returned as [sR | t].
+ * Needs at least 3 non-collinear points.
+ */
+cv::Matx34d similarity_transform_3d (const std::vector<cv::Vec3d>& src, const std::vector<cv::Vec3d>& dst,
+                                     bool withScale=true) {
+    int n = (int)src.size();
+    cv::Vec3d srcMean (0,0,0), dstMean (0,0,0);
+    for (int i=0; i<n; ++i) {
+        srcMean += src[i];
+        dstMean += dst[i];
+    }
+    srcMean *= 1.0/n;
+    dstMean *= 1.0/n;
+
+    cv::Mat_<double> sigma = cv::Mat_<double>::zeros (3,3);
+    double srcVar = 0.0;
+    for (int i=0; i<n; ++i) {
+        cv::Vec3d ds = src[i] - srcMean, dd = dst[i] - dstMean;
+        for (int a=0; a<3; ++a)
+            for (int b=0; b<3; ++b)
+                sigma(a,b) += dd[a]*ds[b] / n;
+        srcVar += ds.dot(ds) / n;
+    }
+
+    cv::Mat w, u, vt;
+    cv::SVD::compute (sigma, w, u, vt);
+    cv::Mat_<double> S = cv::Mat_<double>::eye (3,3);
+    if (cv::determinant (u) * cv::determinant (vt) < 0.0)  // reflection: flip the weakest axis
+        S(2,2) = -1.0;
+    cv::Mat_<double> R = u * S * vt;
+
+    double scale = 1.0;
+    if (withScale && srcVar > 0.0)
+        scale = (w.at<double>(0) + w.at<double>(1) + S(2,2)*w.at<double>(2)) / srcVar;
+
+    cv::Matx34d T;
+    for (int a=0; a<3; ++a) {
+        double Rsrc = R(a,0)*srcMean[0] + R(a,1)*srcMean[1] + R(a,2)*srcMean[2];
+        for (int b=0; b<3; ++b)
+            T(a,b) = scale * R(a,b);
+        T(a,3) = dstMean[a] - scale * Rsrc;
+    }
+    return (T);
+}
+
+// Applies a [sR | t] transform to a point.
+cv::Vec3d transform_point (const cv::Matx34d& T, const cv::Vec3d& x) {
+    return (cv::Vec3d (T(0,0)*x[0] + T(0,1)*x[1] + T(0,2)*x[2] + T(0,3),
+                       T(1,0)*x[0] + T(1,1)*x[1] + T(1,2)*x[2] + T(1,3),
+                       T(2,0)*x[0] + T(2,1)*x[1] + T(2,2)*x[2] + T(2,3)));
+}
+
 #endif
@@ -0,0 +1,152 @@
+#ifndef DEADLINE_SCHEDULER_HPP__
+#define DEADLINE_SCHEDULER_HPP__
+
+#include <opencv2/core.hpp>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "frame_pool.hpp"
+
+// Ways to cut the detection cost of a camera, in the order they are given to the scheduler.
+enum ShedStep {
+    SHED_ROI,       // detect only around the markers seen last, with a full scan every few frames
+    SHED_SCALE,     // detect on a half size image
+    SHED_IDLE,      // process only every few frames while the camera sees no markers
+    SHED_PREVIEW    // no preview window
+};
+
+// Parses a comma-separated list of steps, e.g. "roi,scale,idle,preview" (no space).
+std::vector<int> parse_shed_steps (const std::string& str) {
+    const char* names[] = {"roi", "scale", "idle", "preview"};
+    std::vector<int> steps;
+    size_t start = 0;
+    while (start < str.length()) {
+        size_t end = str.find (',', start);
+        if (end == std::string::npos) end = str.length();
+        std::string name = str.substr (start, end-start);
+        for (int s=0; s<4; ++s)
+            if (name == names[s]) steps.push_back (s);
+        start = end + 1;
+    }
+    return (steps);
+}
+
+/**
+ * Per-camera deadline on detection + pose estimation time. The time of each frame feeds a
+ * running mean; while it stays over the budget the camera goes one degradation level up
+ * (level k enables the first k configured steps), and once it has stayed well under the
+ * budget for a while it comes one level down again.
+ */
+class DeadlineScheduler {
+public:
+    DeadlineScheduler () : budget(0.0) { }
+    DeadlineScheduler (double budgetSec, const std::vector<int>& shedSteps) : budget(budgetSec), steps(shedSteps) { }
+
+    bool enabled () const { return (budget > 0.0 && !steps.empty()); }
+
+    bool step_active (int camId, int step) {
+        CameraState& s = cams[camId];
+        for (int a=0; a<s.level; ++a)
+            if (steps[a] == step) return (true);
+        return (false);
+    }
+
+    // Called for every frame grabbed; false if the frame should be dropped without detection.
+    bool process_frame (int camId) {
+        CameraState& s = cams[camId];
+        ++s.frame;
+        if (!step_active (camId, SHED_IDLE) || s.frame - s.lastActive < idleAfter) return (true);
+        return (s.frame % idleEvery == 0);
+    }
+
+    // Image region to detect markers in.
+    cv::Rect detection_roi (int camId, cv::Size imageSize) {
+        CameraState& s = cams[camId];
+        if (!step_active (camId, SHED_ROI) || s.roi.area() == 0 || s.frame % fullScanEvery == 0)
+            return (cv::Rect (0, 0, imageSize.width, imageSize.height));
+        return (s.roi);
+    }
+
+    double detection_scale (int camId) { return (step_active (camId, SHED_SCALE) ? 0.5 : 1.0); }
+
+    bool show_preview (int camId) { return (!step_active (camId, SHED_PREVIEW)); }
+
+    // Reports the detection + pose time of a processed frame and the markers found in it.
+    void report (int camId, double seconds, const std::vector< std::vector<cv::Point2f> >& corners, cv::Size imageSize) {
+        CameraState& s = cams[camId];
+        s.meanTime = s.nTimes == 0 ? seconds : s.meanTime + 0.2 * (seconds - s.meanTime);
+        ++s.nTimes;
+        update_roi (s, corners, imageSize);
+        if (!enabled()) return;
+
+        if (s.meanTime > budget) {
+            s.under = 0;
+            if (++s.over >= overPatience && s.level < steps.size()) {
+                ++s.level;
+                s.over = 0;
+                s.nTimes = 0;   // measure the new level from scratch
+            }
+        }
+        else if (s.meanTime < budget * recoverFraction) {
+            s.over = 0;
+            if (++s.under >= underPatience && s.level > 0) {
+                --s.level;
+                s.under = 0;
+                s.nTimes = 0;
+            }
+        }
+    }
+
+    int level (int camId) { return (cams[camId].level); }
+    double mean_time (int camId) { return (cams[camId].meanTime); }
+
+    // e.g. "2 (roi,scale)"
+    std::string level_description (int camId) {
+        const char* names[] = {"roi", "scale", "idle", "preview"};
+        CameraState& s = cams[camId];
+        std::string desc = std::to_string (s.level);
+        for (int a=0; a<s.level; ++a)
+            desc += (a == 0 ? " (" : ",") + std::string (names[steps[a]]);
+        return (s.level > 0 ? desc + ")" : desc);
+    }
+
+private:
+    static const int overPatience = 3, underPatience = 30;
+    static const int idleAfter = 10, idleEvery = 4, fullScanEvery = 10;
+    static constexpr double recoverFraction = 0.6;
+
+    struct CameraState {
+        int level, over, under, nTimes;
+        long frame, lastActive;
+        double meanTime;
+        cv::Rect roi;    // markers of the last processed frame, with room to move
+        CameraState () : level(0), over(0), under(0), nTimes(0), frame(0), lastActive(0), meanTime(0.0) { }
+    };
+
+    double budget;
+    std::vector<int> steps;
+    std::unordered_map<int,CameraState> cams;
+
+    void update_roi (CameraState& s, const std::vector< std::vector<cv::Point2f> >& corners, cv::Size imageSize) {
+        if (corners.empty()) {
+            s.roi = cv::Rect();
+            return;
+        }
+        s.lastActive = s.frame;
+        float x0 = (float)imageSize.width, y0 = (float)imageSize.height, x1 = 0.f, y1 = 0.f;
+        for (int a=0; a<corners.size(); ++a)
+            for (int j=0; j<corners[a].size(); ++j) {
+                x0 = std::min (x0, corners[a][j].x); x1 = std::max (x1, corners[a][j].x);
+                y0 = std::min (y0, corners[a][j].y); y1 = std::max (y1, corners[a][j].y);
+            }
+        // grow by half the box size on each side, and at least 32 pixels
+        float mx = std::max (32.f, (x1-x0) / 2), my = std::max (32.f, (y1-y0) / 2);
+        int left = std::max (0, (int)(x0 - mx)), top = std::max (0, (int)(y0 - my));
+        int right = std::min (imageSize.width, (int)(x1 + mx)), bottom = std::min (imageSize.height, (int)(y1 + my));
+        s.roi = right > left && bottom > top ? cv::Rect (left, top, right-left, bottom-top) : cv::Rect();
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef FRAME_POOL_HPP__
+#define FRAME_POOL_HPP__
+
+#include <opencv2/core.hpp>
+#include <vector>
+#include <deque>
+
+// Resizes a vector of buffers without freeing the buffers that fall off the end: they are
+// parked in 'spare' and handed back (with their capacity) when the vector grows again.
+template <class T>
+void recycle_resize (std::vector<T>& v, std::vector<T>& spare, size_t n) {
+    while (v.size() > n) {
+        spare.push_back (T());
+        spare.back().swap (v.back());
+        v.pop_back();
+    }
+    while (v.size() < n) {
+        v.push_back (T());
+        if (!spare.empty()) {
+            v.back().swap (spare.back());
+            spare.pop_back();
+        }
+    }
+}
+
+// ================================================
+
+// Maps corners found in the region 'roi' of an image scaled by 'scale' back to full image coordinates.
+// Pixel centres map as (x+0.5)/scale - 0.5, as resize (INTER_AREA / INTER_LINEAR) samples them.
+void corners_to_image (std::vector< std::vector<cv::Point2f> >& corners, cv::Rect roi, double scale) {
+    for (int a=0; a<corners.size(); ++a)
+        for (int j=0; j<corners[a].size(); ++j)
+            corners[a][j] = cv::Point2f ((float)((corners[a][j].x + 0.5) / scale - 0.5 + roi.x),
+                                         (float)((corners[a][j].y + 0.5) / scale - 0.5 + roi.y));
+}
+
+// ================================================
+
+/**
+ * Output of detection and pose estimation for one frame. Reused from frame to frame:
+ * resizing keeps the capacity of the outer and the per-marker corner vectors.
+ */
+class DetectionResult {
+public:
+    std::vector<int> ids;
+    std::vector< std::vector<cv::Point2f> > corners, rejected;
+    std::vector<cv::Vec3d> rvecs, tvecs;
+
+    void resize_corners (size_t n) {
+        recycle_resize (corners, spareCorners, n);
+        for (size_t a=0; a<n; ++a) corners[a].resize (4);
+    }
+
+    void resize_rejected (size_t n) {
+        recycle_resize (rejected, spareRejected, n);
+        for (size_t a=0; a<n; ++a) rejected[a].resize (4);
+    }
+
+    // Appends a marker found elsewhere, e.g. in another region of the image or an earlier frame.
+    void append_marker (int id, const std::vector<cv::Point2f>& markerCorners) {
+        resize_corners (corners.size() + 1);
+        corners.back().assign (markerCorners.begin(), markerCorners.end());
+        ids.push_back (id);
+    }
+
+    // Replaces the markers by a copy of 'markerIds' and 'markerCorners', reusing the buffers.
+    void assign_markers (const std::vector<int>& markerIds, const std::vector< std::vector<cv::Point2f> >& markerCorners) {
+        ids.assign (markerIds.begin(), markerIds.end());
+        recycle_resize (corners, spareCorners, markerCorners.size());
+        for (size_t a=0; a<markerCorners.size(); ++a)
+            corners[a].assign (markerCorners[a].begin(), markerCorners[a].end());
+    }
+
+    void append_rejected (const std::vector<cv::Point2f>& candidate) {
+        resize_rejected (rejected.size() + 1);
+        rejected.back().assign (candidate.begin(), candidate.end());
+    }
+
+    void clear () {
+        ids.clear();
+        resize_corners (0);
+        resize_rejected (0);
+        rvecs.clear();
+        tvecs.clear();
+    }
+
+private:
+    std::vector< std::vector<cv::Point2f> > spareCorners, spareRejected;
+};
+
+class FrameSlot {
+public:
+    cv::Mat image, preview;
+    cv::Mat scaled;    // downscaled detection input, when shedding load
+    cv::Mat masked;    // masked crop of the image, with a detection mask
+    DetectionResult det;
+    bool inUse;
+
+    FrameSlot () : inUse(false) { }
+};
+
+/**
+ * Per-camera set of frame buffers and detection results that are recycled through the
+ * capture -> detect -> draw loop, so that once every buffer has reached its size the loop
+ * does not allocate. The tools acquire and release a slot within one loop iteration, so in
+ * practice a single slot is reused; more are only created while slots are held across frames.
+ * When the frame comes from a LatestFrameGrabber, slot.image is only a header onto its buffer.
+ * bin/allocbench checks the steady state.
+ */
+class FramePool {
+public:
+    FramePool (int nSlots=2) : slots(nSlots), next(0) { }
+
+    // Returns a free slot (round robin). If all are in use the pool grows by one slot.
+    FrameSlot& acquire () {
+        for (int a=0; a<slots.size(); ++a) {
+            int k = (next + a) % slots.size();
+            if (!slots[k].inUse) {
+                next = (k + 1) % slots.size();
+                slots[k].inUse = true;
+                return (slots[k]);
+            }
+        }
+        slots.push_back (FrameSlot());  // deque: slots already handed out stay where they are
+        slots.back().inUse = true;
+        return (slots.back());
+    }
+
+    void release (FrameSlot& slot) { slot.inUse = false; }
+
+private:
+    std::deque<FrameSlot> slots;
+    int next;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef FRAME_SOURCE_HPP__
+#define FRAME_SOURCE_HPP__
+
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+/**
+ * Source of frames for detection. retrieve_gray() gives the luma image of the last grabbed
+ * frame in a buffer that is reused from frame to frame (valid until the next grab()), and
+ * retrieve_color() converts to BGR, which is only needed for preview.
+ */
+class FrameSource {
+public:
+    virtual ~FrameSource () { }
+    virtual bool isOpened () const = 0;
+    virtual bool grab () = 0;
+    virtual bool retrieve_gray (cv::Mat& gray) = 0;
+    virtual bool retrieve_color (cv::Mat& color) = 0;
+};
+
+// ================================================
+
+/**
+ * VideoCapture backed source (camera or video file). With 'rawYUYV' the camera is asked for
+ * unconverted YUYV frames and the Y samples are taken directly from the capture buffer,
+ * skipping the YUYV->BGR->gray round trip. The detectors need packed 8-bit pixels and the Y
+ * samples are two bytes apart, so this costs one copy of the luma plane per frame. Backends that ignore the request keep working
+ * through the BGR path.
+ */
+class CaptureFrameSource : public FrameSource {
+public:
+    cv::VideoCapture capture;
+
+    CaptureFrameSource (int camId, bool rawYUYV=false) : frameWidth(0), frameHeight(0), retrieved(false) {
+        capture.open (camId);
+        if (rawYUYV) {
+            capture.set (cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('Y','U','Y','V'));
+            capture.set (cv::CAP_PROP_CONVERT_RGB, 0);
+        }
+        frameWidth = (int)capture.get (cv::CAP_PROP_FRAME_WIDTH);
+        frameHeight = (int)capture.get (cv::CAP_PROP_FRAME_HEIGHT);
+    }
+
+    CaptureFrameSource (const std::string& video) : frameWidth(0), frameHeight(0), retrieved(false) {
+        capture.open (video);
+    }
+
+    bool isOpened () const { return (capture.isOpened()); }
+
+    bool grab () {
+        retrieved = false;
+        return (capture.grab());
+    }
+
+    bool retrieve_gray (cv::Mat& gray) {
+        if (!retrieve_raw()) return (false);
+        if (yuyv.data) {
+            // luma is channel 0 of the interleaved Y0 U Y1 V stream
+            cv::extractChannel (yuyv, grayBuf, 0);
+            gray = grayBuf;
+        }
+        else if (raw.channels() == 1)
+            gray = raw;
+        else {
+            cv::cvtColor (raw, grayBuf, cv::COLOR_BGR2GRAY);
+            gray = grayBuf;
+        }
+        return (true);
+    }
+
+    bool retrieve_color (cv::Mat& color) {
+        if (!retrieve_raw()) return (false);
+        if (yuyv.data)
+            cv::cvtColor (yuyv, colorBuf, cv::COLOR_YUV2BGR_YUYV);
+        else if (raw.channels() == 1)
+            cv::cvtColor (raw, colorBuf, cv::COLOR_GRAY2BGR);
+        else {
+            color = raw;
+            return (true);
+        }
+        color = colorBuf;
+        return (true);
+    }
+
+private:
+    int frameWidth, frameHeight;
+    bool retrieved;
+    cv::Mat raw, yuyv, grayBuf, colorBuf;
+
+    bool retrieve_raw () {
+        if (retrieved) return (true);
+        if (!capture.retrieve (raw)) return (false);
+        retrieved = true;
+        // unconverted YUYV comes either as an HxW 2-channel image or as a single row of bytes
+        yuyv = cv::Mat();
+        if (raw.type() == CV_8UC2)
+            yuyv = raw;
+        else if (raw.channels() == 1 && raw.rows == 1 && (int)raw.total() == 2*frameWidth*frameHeight && frameWidth > 0)
+            yuyv = cv::Mat (frameHeight, frameWidth, CV_8UC2, raw.data);
+        return (true);
+    }
+};
+
+// ================================================
+
+/**
+ * Source reading uncompressed frames from a recording, e.g. one made with
+ *   ffmpeg -f v4l2 -input_format yuyv422 -video_size 640x480 -i /dev/video0 -f rawvideo cam0.yuv
+ * Supported formats: "yuyv" (4:2:2 interleaved), "gray", "i420" and "nv12". For the planar formats
+ * the gray image is a header on the read buffer itself; yuyv luma is copied out once per frame.
+ * With 'loop' the recording starts over when it ends. This allows testing the gray path without a camera.
+ */
+class RawFileFrameSource : public FrameSource {
+public:
+    RawFileFrameSource (const std::string& filename, const std::string& format, int width, int height, bool loop=false)
+                : fmt(format), frameWidth(width), frameHeight(height), frameBytes(0), doLoop(loop), file(NULL) {
+        if (fmt == "yuyv")                     frameBytes = 2*width*height;
+        else if (fmt == "gray")                frameBytes = width*height;
+        else if (fmt == "i420" || fmt == "nv12")  frameBytes = width*height*3/2;
+        else {
+            std::cerr << "Unknown raw frame format '" << fmt << "'." << std::endl;
+            return;
+        }
+        buffer.resize (frameBytes);
+        file = fopen (filename.c_str(), "rb");
+    }
+
+    ~RawFileFrameSource () { if (file) fclose (file); }
+
+    bool isOpened () const { return (file != NULL); }
+
+    bool grab () {
+        if (!file) return (false);
+        if (fread (&buffer[0], 1, frameBytes, file) == frameBytes)
+            return (true);
+        if (!doLoop) return (false);
+        rewind (file);
+        return (fread (&buffer[0], 1, frameBytes, file) == frameBytes);
+    }
+
+    bool retrieve_gray (cv::Mat& gray) {
+        if (fmt == "yuyv") {
+            cv::extractChannel (cv::Mat (frameHeight, frameWidth, CV_8UC2, &buffer[0]), grayBuf, 0);
+            gray = grayBuf;
+        }
+        else
+            gray = cv::Mat (frameHeight, frameWidth, CV_8UC1, &buffer[0]);
+        return (true);
+    }
+
+    bool retrieve_color (cv::Mat& color) {
+        if (fmt == "yuyv")
+            cv::cvtColor (cv::Mat (frameHeight, frameWidth, CV_8UC2, &buffer[0]), colorBuf, cv::COLOR_YUV2BGR_YUYV);
+        else if (fmt == "i420")
+            cv::cvtColor (cv::Mat (frameHeight*3/2, frameWidth, CV_8UC1, &buffer[0]), colorBuf, cv::COLOR_YUV2BGR_I420);
+        else if (fmt == "nv12")
+            cv::cvtColor (cv::Mat (frameHeight*3/2, frameWidth, CV_8UC1, &buffer[0]), colorBuf, cv::COLOR_YUV2BGR_NV12);
+        else
+            cv::cvtColor (cv::Mat (frameHeight, frameWidth, CV_8UC1, &buffer[0]), colorBuf, cv::COLOR_GRAY2BGR);
+        color = colorBuf;
+        return (true);
+    }
+
+private:
+    std::string fmt;
+    int frameWidth, frameHeight;
+    size_t frameBytes;
+    bool doLoop;
+    FILE* file;
+    std::vector<uchar> buffer;
+    cv::Mat grayBuf, colorBuf;
+};
+
+#endif
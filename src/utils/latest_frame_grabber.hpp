@@ -0,0 +1,84 @@
+#ifndef LATEST_FRAME_GRABBER_HPP__
+#define LATEST_FRAME_GRABBER_HPP__
+
+#include <opencv2/core.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "frame_source.hpp"
+
+/**
+ * Keeps draining a FrameSource on its own thread and publishes only the newest gray frame,
+ * stamped with the time it was grabbed. Frames are triple buffered (one being written, one
+ * published, one held by the consumer), so nothing is allocated once the buffers have their size.
+ * A consumer that is slower than the camera therefore always gets a frame at most one period
+ * old, and the frames it never saw are counted as skipped.
+ */
+class LatestFrameGrabber {
+public:
+    LatestFrameGrabber (cv::Ptr<FrameSource> frameSource) : source(frameSource),
+                writeIdx(0), readyIdx(1), readIdx(2), hasNew(false), running(false), ended(false), skippedSinceFetch(0) { }
+
+    ~LatestFrameGrabber () { stop(); }
+
+    void start () {
+        running = true;
+        worker = std::thread (&LatestFrameGrabber::grab_loop, this);
+    }
+
+    void stop () {
+        running = false;
+        if (worker.joinable()) worker.join();
+    }
+
+    // Waits for a frame newer than the previous fetch. 'gray' stays valid until the next fetch.
+    // Returns false once the source has no more frames.
+    bool fetch (cv::Mat& gray, double& timestamp, int& skipped) {
+        std::unique_lock<std::mutex> lock (mtx);
+        newFrame.wait (lock, [this]{ return (hasNew || ended); });
+        if (!hasNew) return (false);
+        std::swap (readIdx, readyIdx);
+        hasNew = false;
+        skipped = skippedSinceFetch;
+        skippedSinceFetch = 0;
+        gray = slots[readIdx];
+        timestamp = stamps[readIdx];
+        return (true);
+    }
+
+private:
+    cv::Ptr<FrameSource> source;
+    cv::Mat slots[3];
+    double stamps[3];
+    int writeIdx, readyIdx, readIdx;
+    bool hasNew;
+    std::atomic<bool> running;
+    bool ended;
+    int skippedSinceFetch;
+    std::mutex mtx;
+    std::condition_variable newFrame;
+    std::thread worker;
+
+    void grab_loop () {
+        cv::Mat gray;
+        while (running) {
+            if (!source->grab()) break;
+            stamps[writeIdx] = ((double)cv::getTickCount()) / cv::getTickFrequency();
+            source->retrieve_gray (gray);
+            gray.copyTo (slots[writeIdx]);
+
+            std::lock_guard<std::mutex> lock (mtx);
+            if (hasNew) ++skippedSinceFetch;
+            std::swap (writeIdx, readyIdx);
+            hasNew = true;
+            newFrame.notify_one();
+        }
+        std::lock_guard<std::mutex> lock (mtx);
+        ended = true;
+        newFrame.notify_one();
+    }
+};
+
+#endif
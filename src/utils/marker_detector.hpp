@@ -0,0 +1,298 @@
+#ifndef MARKER_DETECTOR_HPP__
+#define MARKER_DETECTOR_HPP__
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/aruco.hpp>
+#include <vector>
+#include <algorithm>
+
+#include "marker_whitelist.hpp"
+#include "adaptive_threshold.hpp"
+#include "frame_pool.hpp"
+
+// Homography taking pixel (X,Y) of a side x side square to the quad (corner 0 at (0,0), then
+// clockwise), in closed form (Heckbert's square-to-quad mapping). Meant for warpPerspective
+// with WARP_INVERSE_MAP.
+cv::Matx33d square_to_quad_homography (const cv::Point2f* quad, double side) {
+    double x0 = quad[0].x, x1 = quad[1].x, x2 = quad[2].x, x3 = quad[3].x;
+    double y0 = quad[0].y, y1 = quad[1].y, y2 = quad[2].y, y3 = quad[3].y;
+    double sx = x0 - x1 + x2 - x3, sy = y0 - y1 + y2 - y3;
+    double g = 0.0, h = 0.0;
+    if (sx != 0.0 || sy != 0.0) {
+        double dx1 = x1 - x2, dx2 = x3 - x2, dy1 = y1 - y2, dy2 = y3 - y2;
+        double den = dx1*dy2 - dx2*dy1;
+        g = (sx*dy2 - dx2*sy) / den;
+        h = (dx1*sy - sx*dy1) / den;
+    }
+    double s = 1.0 / (side - 1.0);
+    return (cv::Matx33d ((x1 - x0 + g*x1)*s, (x3 - x0 + h*x3)*s, x0,
+                         (y1 - y0 + g*y1)*s, (y3 - y0 + h*y3)*s, y0,
+                         g*s,                h*s,                1.0));
+}
+
+// Threshold window sizes of the adaptiveThreshWinSize* range of the parameters, as aruco uses them.
+void threshold_windows (const cv::aruco::DetectorParameters& params, std::vector<int>& winSizes) {
+    winSizes.clear();
+    int winStep = std::max (1, params.adaptiveThreshWinSizeStep);
+    int nWinSizes = (params.adaptiveThreshWinSizeMax - params.adaptiveThreshWinSizeMin) / winStep + 1;
+    for (int i=0; i<nWinSizes; ++i) {
+        int winSize = std::max (3, params.adaptiveThreshWinSizeMin + i*winStep);
+        if (winSize % 2 == 0) winSize++;
+        winSizes.push_back (winSize);
+    }
+}
+
+// ================================================
+
+/**
+ * Marker detector following the same stages and parameters as aruco::detectMarkers
+ * (adaptive thresholding, quad extraction, bit extraction, corner refinement), but
+ * thresholding all window sizes in a single pass over one integral image, and
+ * decoding candidates against a MarkerWhitelist of packed 64-bit codes instead of
+ * the whole dictionary.
+ */
+class MarkerDetector {
+public:
+    struct Candidate {
+        cv::Point2f corners[4];
+        double perimeter;
+        int id, rotation;
+        int window;    // threshold window size the candidate was found with
+    };
+
+    // Candidate funnel and time per phase of the last detect()
+    struct Stats {
+        int contours, candidates, rejected, accepted;
+        double thresholdMs, contoursMs, decodeMs, refineMs;
+    };
+
+    cv::aruco::DetectorParameters params;
+    MarkerWhitelist whitelist;
+    std::vector<int> windowSizes;    // if not empty, used instead of the adaptiveThreshWinSize* range
+
+    // Threshold window size and perimeter (relative to the larger image side) of each marker of the last detect()
+    std::vector<int> markerWindows;
+    std::vector<double> markerPerimeterRates;
+    Stats stats;
+
+    MarkerDetector () { }
+
+    MarkerDetector (const cv::aruco::Dictionary& dictionary, const cv::aruco::DetectorParameters& detectorParams,
+                    const std::vector<int>& allowedIds)
+            : params(detectorParams), whitelist(dictionary, allowedIds) { }
+
+    // Fills result.ids, result.corners and result.rejected, reusing their buffers.
+    void detect (const cv::Mat& image, DetectionResult& result) {
+        if (image.channels() == 3)  cv::cvtColor (image, grey, cv::COLOR_BGR2GRAY);
+        else  grey = image;
+
+        detect_candidates ();
+
+        double tick = (double)cv::getTickCount();
+        int nAccepted = 0;
+        for (int a=0; a<candidates.size(); ++a) {
+            if (identify_candidate (candidates[a].corners, candidates[a].id, candidates[a].rotation)) ++nAccepted;
+            else candidates[a].id = -1;
+        }
+        stats.decodeMs = elapsed_ms (tick);
+        stats.candidates = (int)candidates.size();
+        stats.accepted = nAccepted;
+        stats.rejected = stats.candidates - nAccepted;
+
+        result.ids.resize (nAccepted);
+        result.resize_corners (nAccepted);
+        result.resize_rejected (candidates.size() - nAccepted);
+        markerWindows.resize (nAccepted);
+        markerPerimeterRates.resize (nAccepted);
+        int maxDim = std::max (grey.cols, grey.rows);
+        int na = 0, nr = 0;
+        for (int a=0; a<candidates.size(); ++a) {
+            const Candidate& c = candidates[a];
+            if (c.id >= 0) {
+                for (int j=0; j<4; ++j)
+                    result.corners[na][j] = c.corners[(j+4-c.rotation)%4];
+                markerWindows[na] = c.window;
+                markerPerimeterRates[na] = c.perimeter / maxDim;
+                result.ids[na++] = c.id;
+            }
+            else {
+                for (int j=0; j<4; ++j)
+                    result.rejected[nr][j] = c.corners[j];
+                ++nr;
+            }
+        }
+
+        tick = (double)cv::getTickCount();
+        if (params.doCornerRefinement)
+            for (int a=0; a<result.corners.size(); ++a)
+                cv::cornerSubPix (grey, result.corners[a], cv::Size(params.cornerRefinementWinSize, params.cornerRefinementWinSize),
+                                  cv::Size(-1,-1), cv::TermCriteria (cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+                                          params.cornerRefinementMaxIterations, params.cornerRefinementMinAccuracy));
+        stats.refineMs = elapsed_ms (tick);
+    }
+
+    void detect (const cv::Mat& image, std::vector< std::vector<cv::Point2f> >& corners, std::vector<int>& ids,
+                 std::vector< std::vector<cv::Point2f> >& rejected) {
+        detect (image, ownResult);
+        corners = ownResult.corners;
+        ids = ownResult.ids;
+        rejected = ownResult.rejected;
+    }
+
+private:
+    cv::Mat grey, warped;
+    DetectionResult ownResult;
+    MultiWindowThreshold multiThreshold;
+    std::vector<int> winSizes;
+    std::vector<cv::Mat> threshImgs;
+    std::vector<Candidate> candidates;
+    std::vector< std::vector<cv::Point> > contours;
+    std::vector<cv::Point> approxCurve;
+
+    // ------------------------------------------------
+
+    static double elapsed_ms (double tick) {
+        return (((double)cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency());
+    }
+
+    void detect_candidates () {
+        double tick = (double)cv::getTickCount();
+        candidates.clear();
+        if (windowSizes.empty())
+            threshold_windows (params, winSizes);
+        else
+            winSizes = windowSizes;
+
+        multiThreshold.apply (grey, winSizes, params.adaptiveThreshConstant, threshImgs);
+        stats.thresholdMs = elapsed_ms (tick);
+
+        tick = (double)cv::getTickCount();
+        stats.contours = 0;
+        for (int i=0; i<threshImgs.size(); ++i)
+            find_quads (threshImgs[i], winSizes[i]);
+        filter_too_close_candidates ();
+        stats.contoursMs = elapsed_ms (tick);
+    }
+
+    // Same acceptance rules as aruco's _findMarkerContours. Destroys 'bin'.
+    void find_quads (cv::Mat& bin, int window) {
+        int maxDim = std::max (bin.cols, bin.rows);
+        unsigned int minPerimeterPixels = (unsigned int)(params.minMarkerPerimeterRate * maxDim);
+        unsigned int maxPerimeterPixels = (unsigned int)(params.maxMarkerPerimeterRate * maxDim);
+
+        cv::findContours (bin, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+        stats.contours += (int)contours.size();
+        for (int i=0; i<contours.size(); ++i) {
+            if (contours[i].size() < minPerimeterPixels || contours[i].size() > maxPerimeterPixels)
+                continue;
+            cv::approxPolyDP (contours[i], approxCurve, double(contours[i].size()) * params.polygonalApproxAccuracyRate, true);
+            if (approxCurve.size() != 4 || !cv::isContourConvex (approxCurve))
+                continue;
+
+            double minDistSq = double(maxDim) * maxDim;
+            for (int j=0; j<4; ++j) {
+                cv::Point d = approxCurve[j] - approxCurve[(j+1)%4];
+                minDistSq = std::min (minDistSq, double(d.x)*d.x + double(d.y)*d.y);
+            }
+            double minCornerDistancePixels = double(contours[i].size()) * params.minCornerDistanceRate;
+            if (minDistSq < minCornerDistancePixels * minCornerDistancePixels)
+                continue;
+
+            bool tooNearBorder = false;
+            for (int j=0; j<4; ++j)
+                if (approxCurve[j].x < params.minDistanceToBorder || approxCurve[j].y < params.minDistanceToBorder ||
+                        approxCurve[j].x > bin.cols-1-params.minDistanceToBorder ||
+                        approxCurve[j].y > bin.rows-1-params.minDistanceToBorder)
+                    tooNearBorder = true;
+            if (tooNearBorder)
+                continue;
+
+            Candidate c;
+            c.perimeter = (double)contours[i].size();
+            c.window = window;
+            for (int j=0; j<4; ++j)
+                c.corners[j] = cv::Point2f (approxCurve[j].x, approxCurve[j].y);
+            // make the corners clockwise, as aruco does
+            cv::Point2f v1 = c.corners[1] - c.corners[0], v2 = c.corners[2] - c.corners[0];
+            if (v1.x*v2.y - v1.y*v2.x < 0.0)
+                std::swap (c.corners[1], c.corners[3]);
+            candidates.push_back (c);
+        }
+    }
+
+    // Of two candidates closer than minMarkerDistanceRate (of the smaller perimeter, as in aruco's
+    // _filterTooCloseCandidates), keep the one with the larger perimeter (the same quad is usually
+    // found at more than one threshold window size).
+    void filter_too_close_candidates () {
+        std::vector<bool> toRemove (candidates.size(), false);
+        for (int i=0; i<candidates.size(); ++i)
+            for (int j=i+1; j<candidates.size(); ++j) {
+                if (toRemove[i] || toRemove[j]) continue;
+                double minDist = std::min (candidates[i].perimeter, candidates[j].perimeter) * params.minMarkerDistanceRate;
+                double minDistSq = minDist * minDist;
+                bool tooClose = false;
+                for (int fc=0; fc<4 && !tooClose; ++fc) {
+                    double distSq = 0.0;
+                    for (int c=0; c<4; ++c) {
+                        cv::Point2f d = candidates[i].corners[(fc+c)%4] - candidates[j].corners[c];
+                        distSq += d.x*d.x + d.y*d.y;
+                    }
+                    tooClose = (distSq/4.0 < minDistSq);
+                }
+                if (tooClose) {
+                    if (candidates[i].perimeter > candidates[j].perimeter) toRemove[j] = true;
+                    else toRemove[i] = true;
+                }
+            }
+        int n = 0;
+        for (int i=0; i<candidates.size(); ++i)
+            if (!toRemove[i]) candidates[n++] = candidates[i];
+        candidates.resize (n);
+    }
+
+    // Warps the candidate, samples one bit per cell (border cells first, so non-markers
+    // are rejected before the code is read) and looks the code up in the whitelist.
+    bool identify_candidate (const cv::Point2f* quad, int& id, int& rotation) {
+        int markerSize = whitelist.markerSize, borderBits = params.markerBorderBits;
+        int cellSize = params.perspectiveRemovePixelPerCell;
+        int cellsPerSide = markerSize + 2*borderBits;
+        int warpedSize = cellsPerSide * cellSize;
+        if (markerSize == 0) return (false);
+
+        cv::warpPerspective (grey, warped, square_to_quad_homography (quad, warpedSize), cv::Size(warpedSize,warpedSize),
+                             cv::INTER_NEAREST | cv::WARP_INVERSE_MAP);
+
+        // uniform candidates carry no code
+        cv::Scalar mean, stddev;
+        cv::meanStdDev (warped (cv::Rect(cellSize/2, cellSize/2, warpedSize-cellSize, warpedSize-cellSize)), mean, stddev);
+        if (stddev[0] < params.minOtsuStdDev)
+            return (false);
+        cv::threshold (warped, warped, 125, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+
+        int margin = int (params.perspectiveRemoveIgnoredMarginPerCell * cellSize);
+        int innerSize = cellSize - 2*margin;
+        int halfInnerPixels = innerSize*innerSize / 2;
+
+        int maxBorderErrors = int (markerSize * markerSize * params.maxErroneousBitsInBorderRate);
+        int borderErrors = 0;
+        for (int y=0; y<cellsPerSide; ++y)
+            for (int x=0; x<cellsPerSide; ++x) {
+                if (y>=borderBits && y<cellsPerSide-borderBits && x>=borderBits && x<cellsPerSide-borderBits)
+                    continue;
+                cv::Mat cell = warped (cv::Rect (x*cellSize+margin, y*cellSize+margin, innerSize, innerSize));
+                if (cv::countNonZero (cell) > halfInnerPixels && ++borderErrors > maxBorderErrors)
+                    return (false);
+            }
+
+        uint64_t code = 0;
+        for (int y=borderBits; y<cellsPerSide-borderBits; ++y)
+            for (int x=borderBits; x<cellsPerSide-borderBits; ++x) {
+                cv::Mat cell = warped (cv::Rect (x*cellSize+margin, y*cellSize+margin, innerSize, innerSize));
+                code = (code << 1) | (cv::countNonZero (cell) > halfInnerPixels ? 1 : 0);
+            }
+
+        return (whitelist.identify (code, id, rotation, params.errorCorrectionRate));
+    }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef MARKER_LAYOUT_HPP__
+#define MARKER_LAYOUT_HPP__
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/aruco.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Reads a list of markers with known 3d placement into an aruco::Board, whose pose can then
+ * be estimated from all visible corners at once with estimatePoseBoard. Each entry is either
+ *   { id: 3, corners: [ x0,y0,z0, x1,y1,z1, x2,y2,z2, x3,y3,z3 ] }
+ * with the corners in aruco order (top-left, top-right, bottom-right, bottom-left), or
+ *   { id: 3, center: [ x,y,z ], size: 0.1, rotation: [ rx,ry,rz ] }
+ * for a square marker of side 'size' that lies in the xy plane facing +z (top edge towards +y),
+ * turned by the optional Rodrigues 'rotation' and moved to 'center'.
+ */
+bool read_marker_list (const cv::FileNode& markers, const cv::aruco::Dictionary& dictionary, cv::aruco::Board& board) {
+    board.objPoints.clear();
+    board.ids.clear();
+    board.dictionary = dictionary;
+    if (!markers.isSeq()) return (false);
+
+    for (cv::FileNodeIterator it=markers.begin(); it!=markers.end(); ++it) {
+        cv::FileNode m = *it;
+        std::vector<double> values;
+        std::vector<cv::Point3f> corners;
+        if (!m["corners"].empty()) {
+            m["corners"] >> values;
+            if (values.size() != 12) return (false);
+            for (int j=0; j<4; ++j)
+                corners.push_back (cv::Point3f ((float)values[3*j], (float)values[3*j+1], (float)values[3*j+2]));
+        }
+        else {
+            double half = (double)m["size"] / 2.0;
+            m["center"] >> values;
+            if (values.size() != 3 || half <= 0.0) return (false);
+            cv::Vec3d center (values[0], values[1], values[2]);
+            cv::Matx33d R = cv::Matx33d::eye();
+            if (!m["rotation"].empty()) {
+                std::vector<double> rvec;
+                m["rotation"] >> rvec;
+                if (rvec.size() != 3) return (false);
+                cv::Rodrigues (cv::Vec3d (rvec[0], rvec[1], rvec[2]), R);
+            }
+            const double sx[4] = {-1, 1, 1, -1}, sy[4] = {1, 1, -1, -1};
+            for (int j=0; j<4; ++j) {
+                cv::Vec3d p = center + R * cv::Vec3d (sx[j]*half, sy[j]*half, 0.0);
+                corners.push_back (cv::Point3f ((float)p[0], (float)p[1], (float)p[2]));
+            }
+        }
+        board.objPoints.push_back (corners);
+        board.ids.push_back ((int)m["id"]);
+    }
+    return (!board.ids.empty());
+}
+
+// Reads a marker layout file, i.e. a YAML/XML file with a 'markers' list as above.
+bool read_marker_layout (const std::string& filename, const cv::aruco::Dictionary& dictionary, cv::aruco::Board& board) {
+    cv::FileStorage fs (filename, cv::FileStorage::READ);
+    if (!fs.isOpened()) return (false);
+    return (read_marker_list (fs["markers"], dictionary, board));
+}
+
+// ================================================
+
+/**
+ * Named rigid body carrying several markers, tracked as one target.
+ */
+struct RigidBody {
+    std::string name;
+    cv::aruco::Board board;
+};
+
+// Reads a rigid body file: a 'bodies' list of { name: robot1, markers: [ ...marker list as above... ] }.
+bool read_rigid_bodies (const std::string& filename, const cv::aruco::Dictionary& dictionary, std::vector<RigidBody>& bodies) {
+    cv::FileStorage fs (filename, cv::FileStorage::READ);
+    if (!fs.isOpened()) return (false);
+    cv::FileNode list = fs["bodies"];
+    if (!list.isSeq()) return (false);
+    bodies.clear();
+    for (cv::FileNodeIterator it=list.begin(); it!=list.end(); ++it) {
+        RigidBody body;
+        body.name = (std::string)(*it)["name"];
+        if (!read_marker_list ((*it)["markers"], dictionary, body.board)) {
+            std::cerr << "Invalid marker list of body '" << body.name << "'" << std::endl;
+            return (false);
+        }
+        bodies.push_back (body);
+    }
+    return (true);
+}
+
+// ================================================
+
+// Transformation taking camera coordinates to the coordinates of a board seen at (rvec, tvec),
+// in the 3x4 [R | t] form of the transformation parameter files.
+cv::Matx34d camera_to_board_transform (const cv::Vec3d& rvec, const cv::Vec3d& tvec) {
+    cv::Matx33d R;
+    cv::Rodrigues (rvec, R);
+    cv::Matx34d T;
+    for (int a=0; a<3; ++a) {
+        for (int b=0; b<3; ++b)
+            T(a,b) = R(b,a);
+        T(a,3) = -(R(0,a)*tvec[0] + R(1,a)*tvec[1] + R(2,a)*tvec[2]);
+    }
+    return (T);
+}
+
+#endif
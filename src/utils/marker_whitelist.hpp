@@ -0,0 +1,100 @@
+#ifndef MARKER_WHITELIST_HPP__
+#define MARKER_WHITELIST_HPP__
+
+#include <opencv2/aruco.hpp>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+// Packs a (markerSize x markerSize) CV_8UC1 bit matrix into a 64-bit word, row-major.
+// 'rotation' follows the convention of aruco::Dictionary::getByteListFromBits, so
+// the rotation reported by MarkerWhitelist::identify can be applied to the corners
+// exactly like aruco::detectMarkers does.
+uint64_t pack_marker_bits (const cv::Mat& bits, int rotation=0) {
+    int n = bits.rows;
+    uint64_t ret = 0;
+    for (int row=0; row<n; ++row)
+        for (int col=0; col<n; ++col) {
+            uchar b;
+            if (rotation==0)       b = bits.at<uchar> (row, col);
+            else if (rotation==1)  b = bits.at<uchar> (col, n-1-row);
+            else if (rotation==2)  b = bits.at<uchar> (n-1-row, n-1-col);
+            else                   b = bits.at<uchar> (n-1-col, row);
+            ret = (ret << 1) | (b ? 1 : 0);
+        }
+    return (ret);
+}
+
+inline int hamming_distance_64 (uint64_t a, uint64_t b) {
+    return (__builtin_popcountll (a ^ b));
+}
+
+// ================================================
+
+/**
+ * Precomputed table of the 4 rotations of a subset of dictionary markers. Candidates
+ * are matched with one xor+popcount per table entry, and anything outside the allowed
+ * ids can never match, so it is rejected without looking at the rest of the dictionary.
+ */
+class MarkerWhitelist {
+public:
+    int markerSize, maxCorrectionBits;
+    std::vector<int> ids;
+    std::vector<uint64_t> rotatedBits; // 4 entries per id: rotations 0,1,2,3
+
+    MarkerWhitelist () : markerSize(0), maxCorrectionBits(0) { }
+
+    // An empty 'allowedIds' uses every marker of the dictionary. Dictionaries with more than
+    // 64 bits per marker cannot be packed and raise a cv::Exception.
+    MarkerWhitelist (const cv::aruco::Dictionary& dictionary, std::vector<int> allowedIds) {
+        markerSize = dictionary.markerSize;
+        maxCorrectionBits = dictionary.maxCorrectionBits;
+        if (markerSize*markerSize > 64)
+            CV_Error (cv::Error::StsBadArg, "Markers with more than 64 bits cannot be packed for the whitelist");
+        if (allowedIds.empty())
+            for (int a=0; a<dictionary.bytesList.rows; ++a)  allowedIds.push_back (a);
+        // in dictionary order, which decides between markers within the correction distance, as in aruco
+        std::sort (allowedIds.begin(), allowedIds.end());
+        allowedIds.erase (std::unique (allowedIds.begin(), allowedIds.end()), allowedIds.end());
+
+        for (int a=0; a<allowedIds.size(); ++a) {
+            int id = allowedIds[a];
+            if (id<0 || id>=dictionary.bytesList.rows) {
+                std::cerr << "Marker id " << id << " is not in the dictionary. Ignoring." << std::endl;
+                continue;
+            }
+            cv::Mat bits = cv::aruco::Dictionary::getBitsFromByteList (dictionary.bytesList.rowRange(id,id+1), markerSize);
+            ids.push_back (id);
+            for (int r=0; r<4; ++r)
+                rotatedBits.push_back (pack_marker_bits (bits, r));
+        }
+    }
+
+    bool empty () const { return (ids.empty()); }
+
+    // Returns true if 'candidateBits' (packed with rotation 0) is within the error
+    // correction distance of an allowed marker. Like aruco::Dictionary::identify, the first
+    // id within the distance wins, with its closest rotation (the first one on ties).
+    bool identify (uint64_t candidateBits, int& id, int& rotation, double errorCorrectionRate) const {
+        int maxDistance = int (double(maxCorrectionBits) * errorCorrectionRate);
+        for (int m=0; m<ids.size(); ++m) {
+            int bestDistance = markerSize*markerSize + 1, bestRotation = 0;
+            for (int r=0; r<4; ++r) {
+                int dist = hamming_distance_64 (candidateBits, rotatedBits[4*m + r]);
+                if (dist < bestDistance) {
+                    bestDistance = dist;
+                    bestRotation = r;
+                }
+            }
+            if (bestDistance <= maxDistance) {
+                id = ids[m];
+                rotation = bestRotation;
+                return (true);
+            }
+        }
+        return (false);
+    }
+};
+
+#endif
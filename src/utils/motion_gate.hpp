@@ -0,0 +1,137 @@
+#ifndef MOTION_GATE_HPP__
+#define MOTION_GATE_HPP__
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Cheap pre-pass that decides where marker detection needs to run. The frame is shrunk by
+ * 'downscale' and compared tile by tile with the image the tiles were last detected in; tiles
+ * whose mean absolute difference exceeds 'threshold' gray levels, plus the tiles under the
+ * bounding boxes of the markers being tracked, are grown by one tile and grouped into rectangles
+ * (overlapping rectangles are merged, so no marker is detected twice). With no changed tile there
+ * is nothing to detect and the previous results still hold. Every fullScanEvery frames the
+ * whole image is scanned regardless.
+ */
+class MotionGate {
+public:
+    MotionGate (int downscale_=8, int tileSize_=8, double threshold_=6.0, int fullScanEvery_=30)
+        : downscale(downscale_), tileSize(tileSize_), threshold(threshold_), fullScanEvery(fullScanEvery_),
+          frame(0), coverage(1.0) { }
+
+    // Fills 'rects' with the regions of 'gray' to run detection in. Returns false if there are none.
+    bool regions (const cv::Mat& gray, const std::vector< std::vector<cv::Point2f> >& tracked, std::vector<cv::Rect>& rects) {
+        rects.clear();
+        cv::resize (gray, small, cv::Size (gray.cols / downscale, gray.rows / downscale), 0, 0, cv::INTER_AREA);
+        if (reference.size() != small.size() || frame++ % fullScanEvery == 0) {
+            small.copyTo (reference);
+            rects.push_back (cv::Rect (0, 0, gray.cols, gray.rows));
+            coverage = 1.0;
+            return (true);
+        }
+
+        tilesX = (small.cols + tileSize - 1) / tileSize;
+        tilesY = (small.rows + tileSize - 1) / tileSize;
+        active.assign (tilesX*tilesY, false);
+        cv::absdiff (small, reference, diff);
+        bool changed = false;
+        for (int ty=0; ty<tilesY; ++ty)
+            for (int tx=0; tx<tilesX; ++tx)
+                if (cv::mean (diff (tile_rect (tx, ty, tx, ty)))[0] > threshold)
+                    active[ty*tilesX + tx] = changed = true;
+        if (!changed) {
+            coverage = 0.0;
+            return (false);
+        }
+
+        // whole markers: a region holding only some of their corners would not detect them
+        for (int a=0; a<tracked.size(); ++a) {
+            if (tracked[a].empty()) continue;
+            int tx0 = tilesX-1, ty0 = tilesY-1, tx1 = 0, ty1 = 0;
+            for (int j=0; j<tracked[a].size(); ++j) {
+                int tx = std::min (tilesX-1, std::max (0, (int)(tracked[a][j].x / downscale) / tileSize));
+                int ty = std::min (tilesY-1, std::max (0, (int)(tracked[a][j].y / downscale) / tileSize));
+                tx0 = std::min (tx0, tx); tx1 = std::max (tx1, tx);
+                ty0 = std::min (ty0, ty); ty1 = std::max (ty1, ty);
+            }
+            for (int ty=ty0; ty<=ty1; ++ty)
+                for (int tx=tx0; tx<=tx1; ++tx)
+                    active[ty*tilesX + tx] = true;
+        }
+
+        // grow by one tile, then one rectangle per 8-connected group of tiles
+        grown.assign (tilesX*tilesY, false);
+        for (int ty=0; ty<tilesY; ++ty)
+            for (int tx=0; tx<tilesX; ++tx)
+                if (active[ty*tilesX + tx])
+                    for (int y=std::max (0, ty-1); y<=std::min (tilesY-1, ty+1); ++y)
+                        for (int x=std::max (0, tx-1); x<=std::min (tilesX-1, tx+1); ++x)
+                            grown[y*tilesX + x] = true;
+        for (int t=0; t<grown.size(); ++t) {
+            if (!grown[t]) continue;
+            int x0 = t % tilesX, x1 = x0, y0 = t / tilesX, y1 = y0;
+            stack.assign (1, t);
+            grown[t] = false;
+            while (!stack.empty()) {
+                int c = stack.back();
+                stack.pop_back();
+                int cx = c % tilesX, cy = c / tilesX;
+                x0 = std::min (x0, cx); x1 = std::max (x1, cx); y0 = std::min (y0, cy); y1 = std::max (y1, cy);
+                for (int y=std::max (0, cy-1); y<=std::min (tilesY-1, cy+1); ++y)
+                    for (int x=std::max (0, cx-1); x<=std::min (tilesX-1, cx+1); ++x)
+                        if (grown[y*tilesX + x]) {
+                            grown[y*tilesX + x] = false;
+                            stack.push_back (y*tilesX + x);
+                        }
+            }
+            // these tiles are being looked at now: they become the reference
+            cv::Rect smallRect = tile_rect (x0, y0, x1, y1);
+            small (smallRect).copyTo (reference (smallRect));
+            cv::Rect r (smallRect.x*downscale, smallRect.y*downscale, smallRect.width*downscale, smallRect.height*downscale);
+            if (r.x + r.width >= gray.cols - downscale) r.width = gray.cols - r.x;    // include the rows and columns lost to
+            if (r.y + r.height >= gray.rows - downscale) r.height = gray.rows - r.y;  // the integer division above
+            rects.push_back (r);
+        }
+
+        // the bounding boxes of separate groups can overlap: merge them
+        for (bool merged=true; merged; ) {
+            merged = false;
+            for (int a=0; a<rects.size() && !merged; ++a)
+                for (int b=a+1; b<rects.size() && !merged; ++b)
+                    if ((rects[a] & rects[b]).area() > 0) {
+                        rects[a] |= rects[b];
+                        rects.erase (rects.begin() + b);
+                        merged = true;
+                    }
+        }
+        double area = 0.0;
+        for (int a=0; a<rects.size(); ++a)
+            area += rects[a].area();
+        coverage = area / gray.total();
+        return (true);
+    }
+
+    // Fraction of the image the last call asked to detect in.
+    double last_coverage () const { return (coverage); }
+
+private:
+    int downscale, tileSize;
+    double threshold;
+    int fullScanEvery;
+    long frame;
+    double coverage;
+    int tilesX, tilesY;
+    cv::Mat small, reference, diff;
+    std::vector<bool> active, grown;
+    std::vector<int> stack;
+
+    // Rectangle of tiles (x0,y0)-(x1,y1) in the small image.
+    cv::Rect tile_rect (int x0, int y0, int x1, int y1) const {
+        int right = std::min (small.cols, (x1+1)*tileSize), bottom = std::min (small.rows, (y1+1)*tileSize);
+        return (cv::Rect (x0*tileSize, y0*tileSize, right - x0*tileSize, bottom - y0*tileSize));
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef PDF_WRITER_HPP__
+#define PDF_WRITER_HPP__
+
+#include <opencv2/core.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+/**
+ * Minimal PDF writer for printable marker pages. Pages are appended one at a time and only
+ * the object offsets are kept in memory, so documents of any length can be written. A page
+ * is a content stream, optionally with one black/white image drawn over the whole page.
+ * Page sizes are in points (1/72 inch); text can use Helvetica as font /F1.
+ */
+class PdfWriter {
+public:
+    // Black/white raster, 1 bit per pixel (1 = white), rows padded to whole bytes, RunLength encoded.
+    struct Bilevel {
+        int width, height;
+        std::string data;
+    };
+
+    PdfWriter () : nPages(0) { }
+    ~PdfWriter () { if (file.is_open()) close(); }
+
+    bool open (const std::string& filename) {
+        file.open (filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return (false);
+        offsets.assign (2, 0);  // objects 1 (catalog) and 2 (page tree) are written by close()
+        pageObjs.clear();
+        nPages = 0;
+        file << "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n";
+        return (file.good());
+    }
+
+    // Encodes an 8-bit gray image (pixels >= 128 are white). Safe to call from several threads.
+    static void encode_bilevel (const cv::Mat& gray, Bilevel& out) {
+        out.width = gray.cols;
+        out.height = gray.rows;
+        int rowBytes = (gray.cols + 7) / 8;
+        std::vector<unsigned char> packed (rowBytes * gray.rows, 0);
+        for (int y=0; y<gray.rows; ++y) {
+            const unsigned char* row = gray.ptr<unsigned char>(y);
+            unsigned char* dst = &packed[y*rowBytes];
+            for (int x=0; x<gray.cols; ++x)
+                if (row[x] >= 128) dst[x>>3] |= (unsigned char)(0x80 >> (x&7));
+        }
+        run_length_encode (packed, out.data);
+    }
+
+    // Adds a page of widthPt x heightPt points. 'content' is the page's content stream;
+    // if 'image' is given it is drawn first, scaled to the whole page.
+    void add_page (double widthPt, double heightPt, const std::string& content, const Bilevel* image=0) {
+        int pageObj = (int)offsets.size() + 1;
+        int contentObj = pageObj + 1;
+        int imageObj = pageObj + 2;
+
+        std::ostringstream page;
+        page << "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " << widthPt << " " << heightPt << "]"
+             << " /Contents " << contentObj << " 0 R /Resources << /Font << /F1 << /Type /Font /Subtype /Type1 /BaseFont /Helvetica >> >> ";
+        if (image) page << "/XObject << /Im0 " << imageObj << " 0 R >> ";
+        page << ">> >>";
+        begin_object();
+        file << page.str() << "\nendobj\n";
+
+        std::ostringstream stream;
+        if (image) stream << "q " << widthPt << " 0 0 " << heightPt << " 0 0 cm /Im0 Do Q\n";
+        stream << content;
+        begin_object();
+        write_stream ("", stream.str());
+
+        if (image) {
+            std::ostringstream dict;
+            dict << "/Type /XObject /Subtype /Image /Width " << image->width << " /Height " << image->height
+                 << " /ColorSpace /DeviceGray /BitsPerComponent 1 /Filter /RunLengthDecode";
+            begin_object();
+            write_stream (dict.str(), image->data);
+        }
+        pageObjs.push_back (pageObj);
+        ++nPages;
+    }
+
+    int page_count () const { return (nPages); }
+
+    // Writes the page tree, catalog and cross-reference table.
+    bool close () {
+        offsets[1] = (long)file.tellp();
+        file << "2 0 obj\n<< /Type /Pages /Count " << nPages << " /Kids [";
+        for (int a=0; a<pageObjs.size(); ++a)
+            file << " " << pageObjs[a] << " 0 R";
+        file << " ] >>\nendobj\n";
+        offsets[0] = (long)file.tellp();
+        file << "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+
+        long xref = (long)file.tellp();
+        file << "xref\n0 " << offsets.size()+1 << "\n0000000000 65535 f \n";
+        char line[32];
+        for (int a=0; a<offsets.size(); ++a) {
+            snprintf (line, sizeof(line), "%010ld 00000 n \n", offsets[a]);
+            file << line;
+        }
+        file << "trailer\n<< /Size " << offsets.size()+1 << " /Root 1 0 R >>\nstartxref\n" << xref << "\n%%EOF\n";
+        bool ok = file.good();
+        file.close();
+        return (ok);
+    }
+
+private:
+    std::ofstream file;
+    std::vector<long> offsets;   // byte offset of object a+1
+    std::vector<int> pageObjs;
+    int nPages;
+
+    void begin_object () {
+        offsets.push_back ((long)file.tellp());
+        file << offsets.size() << " 0 obj\n";
+    }
+
+    void write_stream (const std::string& dict, const std::string& data) {
+        file << "<< " << dict << (dict.empty() ? "" : " ") << "/Length " << data.size() << " >>\nstream\n";
+        file.write (data.data(), data.size());
+        file << "\nendstream\nendobj\n";
+    }
+
+    // PDF RunLengthDecode: n+1 literal bytes follow a length byte n < 128, a byte repeated 257-n times follows n > 128.
+    static void run_length_encode (const std::vector<unsigned char>& in, std::string& out) {
+        out.clear();
+        int n = (int)in.size(), a = 0;
+        while (a < n) {
+            int run = 1;
+            while (a+run < n && run < 128 && in[a+run] == in[a]) ++run;
+            if (run >= 2) {
+                out += (char)(257 - run);
+                out += (char)in[a];
+                a += run;
+                continue;
+            }
+            int start = a, len = 0;
+            while (a < n && len < 128 && !(a+1 < n && in[a+1] == in[a])) { ++a; ++len; }
+            out += (char)(len - 1);
+            out.append ((const char*)&in[start], len);
+        }
+        out += (char)128;
+    }
+};
+
+#endif
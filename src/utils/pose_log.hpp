@@ -0,0 +1,307 @@
+#ifndef POSE_LOG_HPP__
+#define POSE_LOG_HPP__
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * One fused pose, in ground coordinates.
+ */
+struct PoseRecord {
+    double timestamp;          // capture time of the newest averaged reading, seconds, tick clock of the tracker (see PoseLogReader::clock_offset)
+    int id;                    // marker id, or -1-b for rigid body b of the bodies file
+    unsigned int cameras;      // bit c set if camera c contributed (cameras 0..31)
+    cv::Vec3d tvec, headvec;
+    cv::Matx33d cov;           // sample covariance (scatter/(n-1)) of the averaged tvecs; zero for a single reading
+};
+
+/**
+ * Pose log file layout. A header page, then blocks of blockRecords records stored column by
+ * column (all timestamps of the block, then all ids, ...), so a reader touches only the columns
+ * it needs. Every block starts with the time span of its records, which is the time index:
+ * records are appended in time order, so a time is found by a binary search over the blocks.
+ * trackmarkers stamps records with capture times and sorts each round, but a camera with more
+ * latency than the others can still step back by that latency across rounds; a time search is
+ * then only exact to within it.
+ */
+namespace pose_log {
+    const char magic[8] = {'P','O','S','E','L','O','G','\0'};
+    const uint32_t version = 1;
+    const size_t headerSize = 4096, blockHeaderSize = 64;
+    const size_t recordSize = 8 + 4 + 4 + 3*8 + 3*8 + 9*8;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version, blockRecords;
+        uint64_t nRecords;
+        double clockOffset;    // add to timestamps to get Unix time
+    };
+    struct BlockHeader {
+        double tFirst, tLast;
+        uint32_t count;
+    };
+
+    // Column pointers of a block.
+    struct Columns {
+        double* t;
+        int32_t* id;
+        uint32_t* cameras;
+        double *tvec, *headvec, *cov;    // 3, 3 and 9 values per record
+    };
+
+    inline size_t block_size (size_t blockRecords) { return (blockHeaderSize + blockRecords * recordSize); }
+
+    inline Columns columns (unsigned char* block, size_t blockRecords) {
+        Columns c;
+        unsigned char* p = block + blockHeaderSize;
+        c.t = (double*)p;              p += 8 * blockRecords;
+        c.id = (int32_t*)p;            p += 4 * blockRecords;
+        c.cameras = (uint32_t*)p;      p += 4 * blockRecords;
+        c.tvec = (double*)p;           p += 24 * blockRecords;
+        c.headvec = (double*)p;        p += 24 * blockRecords;
+        c.cov = (double*)p;
+        return (c);
+    }
+}
+
+/**
+ * Appends PoseRecords to a memory-mapped pose log. append() only queues the record; a writer
+ * thread copies the queued records into the mapping in batches (every batchSize records or
+ * half a second) and grows the file a few blocks at a time.
+ */
+class PoseLogWriter {
+public:
+    PoseLogWriter () : fd(-1), map(0), mapSize(0), blockRecords(0), nRecords(0), stopping(false) { }
+    ~PoseLogWriter () { close(); }
+
+    // Creates (or truncates) the log file and starts the writer thread.
+    bool open (const std::string& filename, int blockRecords_=4096) {
+        close();
+        fd = ::open (filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return (false);
+        blockRecords = blockRecords_;
+        nRecords = 0;
+        if (!grow (growBlocks)) {
+            close();
+            return (false);
+        }
+        pose_log::FileHeader* h = header();
+        memcpy (h->magic, pose_log::magic, 8);
+        h->version = pose_log::version;
+        h->blockRecords = blockRecords;
+        h->nRecords = 0;
+        h->clockOffset = std::chrono::duration<double> (std::chrono::system_clock::now().time_since_epoch()).count()
+                         - (double)cv::getTickCount() / cv::getTickFrequency();
+        stopping = false;
+        pending.reserve (batchSize);
+        batch.reserve (batchSize);
+        worker = std::thread (&PoseLogWriter::write_loop, this);
+        return (true);
+    }
+
+    bool is_open () const { return (fd >= 0); }
+
+    void append (const PoseRecord& r) {
+        std::lock_guard<std::mutex> lock (mtx);
+        pending.push_back (r);
+        if (pending.size() >= batchSize) wake.notify_one();
+    }
+
+    // Writes what is queued, cuts the file to the blocks in use and closes it.
+    void close () {
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock (mtx);
+                stopping = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+        if (map) {
+            size_t used = pose_log::headerSize + (nRecords + blockRecords - 1) / blockRecords * pose_log::block_size (blockRecords);
+            msync (map, mapSize, MS_SYNC);
+            munmap (map, mapSize);
+            map = 0;
+            ftruncate (fd, used);
+        }
+        if (fd >= 0) ::close (fd);
+        fd = -1;
+    }
+
+private:
+    static const size_t batchSize = 256, growBlocks = 16;
+
+    int fd;
+    unsigned char* map;
+    size_t mapSize, blockRecords;
+    uint64_t nRecords;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping;
+    std::vector<PoseRecord> pending, batch;   // swapped by the writer thread
+
+    pose_log::FileHeader* header () { return ((pose_log::FileHeader*)map); }
+
+    // Maps room for nBlocks more blocks.
+    bool grow (size_t nBlocks) {
+        size_t blocks = mapSize == 0 ? 0 : (mapSize - pose_log::headerSize) / pose_log::block_size (blockRecords);
+        size_t size = pose_log::headerSize + (blocks + nBlocks) * pose_log::block_size (blockRecords);
+        if (map) munmap (map, mapSize);
+        map = 0;
+        mapSize = 0;
+        if (ftruncate (fd, size) != 0) return (false);
+        void* m = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED) return (false);
+        map = (unsigned char*)m;
+        mapSize = size;
+        return (true);
+    }
+
+    void write_loop () {
+        const std::chrono::milliseconds flushInterval (500);
+        std::unique_lock<std::mutex> lock (mtx);
+        while (true) {
+            wake.wait_for (lock, flushInterval,
+                           [this]{ return (stopping || pending.size() >= batchSize); });
+            bool last = stopping;
+            batch.swap (pending);
+            lock.unlock();
+            write_batch();
+            batch.clear();
+            lock.lock();
+            if (last) break;
+        }
+    }
+
+    void write_batch () {
+        if (batch.empty() || !map) return;
+        size_t blockSize = pose_log::block_size (blockRecords);
+        for (int a=0; a<batch.size(); ++a) {
+            size_t block = nRecords / blockRecords, slot = nRecords % blockRecords;
+            if (pose_log::headerSize + (block+1) * blockSize > mapSize && !grow (growBlocks)) return;
+            unsigned char* b = map + pose_log::headerSize + block * blockSize;
+            pose_log::Columns c = pose_log::columns (b, blockRecords);
+            const PoseRecord& r = batch[a];
+            c.t[slot] = r.timestamp;
+            c.id[slot] = r.id;
+            c.cameras[slot] = r.cameras;
+            for (int k=0; k<3; ++k) {
+                c.tvec[3*slot + k] = r.tvec[k];
+                c.headvec[3*slot + k] = r.headvec[k];
+            }
+            for (int k=0; k<9; ++k)
+                c.cov[9*slot + k] = r.cov.val[k];
+            pose_log::BlockHeader* bh = (pose_log::BlockHeader*)b;
+            if (slot == 0) bh->tFirst = r.timestamp;
+            bh->tLast = r.timestamp;
+            bh->count = slot + 1;
+            ++nRecords;
+        }
+        header()->nRecords = nRecords;   // records become visible to readers once complete
+    }
+};
+
+/**
+ * Read-only mapping of a pose log, with access by record index and a time search that only
+ * touches the block headers and the timestamp column of one block.
+ */
+class PoseLogReader {
+public:
+    PoseLogReader () : map(0), mapSize(0), blockRecords(0), nRecords(0) { }
+    ~PoseLogReader () { close(); }
+
+    bool open (const std::string& filename) {
+        close();
+        int fd = ::open (filename.c_str(), O_RDONLY);
+        if (fd < 0) return (false);
+        struct stat st;
+        if (fstat (fd, &st) != 0 || st.st_size < (off_t)pose_log::headerSize) {
+            ::close (fd);
+            return (false);
+        }
+        void* m = mmap (0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close (fd);
+        if (m == MAP_FAILED) return (false);
+        map = (const unsigned char*)m;
+        mapSize = st.st_size;
+
+        const pose_log::FileHeader* h = (const pose_log::FileHeader*)map;
+        blockRecords = h->blockRecords;
+        nRecords = h->nRecords;
+        if (memcmp (h->magic, pose_log::magic, 8) != 0 || h->version != pose_log::version || blockRecords == 0
+                || pose_log::headerSize + n_blocks() * pose_log::block_size (blockRecords) > mapSize) {
+            close();
+            return (false);
+        }
+        return (true);
+    }
+
+    void close () {
+        if (map) munmap ((void*)map, mapSize);
+        map = 0;
+        nRecords = 0;
+    }
+
+    size_t size () const { return (nRecords); }
+    size_t n_blocks () const { return ((nRecords + blockRecords - 1) / blockRecords); }
+    double clock_offset () const { return (((const pose_log::FileHeader*)map)->clockOffset); }
+
+    double timestamp (size_t i) const { return (columns (i / blockRecords).t[i % blockRecords]); }
+
+    void get (size_t i, PoseRecord& r) const {
+        pose_log::Columns c = columns (i / blockRecords);
+        size_t slot = i % blockRecords;
+        r.timestamp = c.t[slot];
+        r.id = c.id[slot];
+        r.cameras = c.cameras[slot];
+        for (int k=0; k<3; ++k) {
+            r.tvec[k] = c.tvec[3*slot + k];
+            r.headvec[k] = c.headvec[3*slot + k];
+        }
+        for (int k=0; k<9; ++k)
+            r.cov.val[k] = c.cov[9*slot + k];
+    }
+
+    // Index of the first record at or after time t (size() if there is none).
+    size_t lower_bound (double t) const {
+        size_t lo = 0, hi = n_blocks();
+        while (lo < hi) {    // first block ending at or after t
+            size_t mid = (lo + hi) / 2;
+            if (block_header (mid)->tLast < t) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == n_blocks()) return (nRecords);
+        const double* ts = columns (lo).t;
+        size_t first = 0, last = block_header (lo)->count;
+        while (first < last) {
+            size_t mid = (first + last) / 2;
+            if (ts[mid] < t) first = mid + 1;
+            else last = mid;
+        }
+        return (lo * blockRecords + first);
+    }
+
+private:
+    const unsigned char* map;
+    size_t mapSize, blockRecords;
+    uint64_t nRecords;
+
+    const unsigned char* block (size_t b) const { return (map + pose_log::headerSize + b * pose_log::block_size (blockRecords)); }
+    const pose_log::BlockHeader* block_header (size_t b) const { return ((const pose_log::BlockHeader*)block (b)); }
+    pose_log::Columns columns (size_t b) const { return (pose_log::columns ((unsigned char*)block (b), blockRecords)); }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef ROI_MASK_HPP__
+#define ROI_MASK_HPP__
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * Static region of a camera image where markers are looked for. Read from an image file
+ * (non-zero pixels are detected in) or from a YAML/XML file with a list of polygons,
+ *   polygons: [ [ x0,y0, x1,y1, x2,y2, ... ], ... ]
+ * in pixels. apply() crops the frame to the bounding box of the region and flattens the pixels
+ * outside it, so thresholding finds no contours there; corners found in the crop are moved
+ * back with corners_to_image (corners, bounds(), 1.0). The detector sees the crop as its image:
+ * minDistanceToBorder is measured from the crop border, and perimeter rates relative to the
+ * crop size must be rescaled by the caller to stay relative to the frame.
+ */
+class RoiMask {
+public:
+    RoiMask () : full(true) { }
+
+    bool load (const std::string& filename) {
+        source.release();
+        polygons.clear();
+        mask.release();
+        size_t dot = filename.rfind ('.');
+        std::string ext = dot == std::string::npos ? "" : filename.substr (dot+1);
+        if (ext == "yml" || ext == "yaml" || ext == "xml" || ext == "json") {
+            cv::FileStorage fs (filename, cv::FileStorage::READ);
+            if (!fs.isOpened() || !fs["polygons"].isSeq()) return (false);
+            cv::FileNode list = fs["polygons"];
+            for (cv::FileNodeIterator it=list.begin(); it!=list.end(); ++it) {
+                std::vector<int> xy;
+                (*it) >> xy;
+                if (xy.size() < 6 || xy.size() % 2 != 0) return (false);
+                polygons.push_back (std::vector<cv::Point>());
+                for (int a=0; a<xy.size(); a+=2)
+                    polygons.back().push_back (cv::Point (xy[a], xy[a+1]));
+            }
+            return (!polygons.empty());
+        }
+        source = cv::imread (filename, cv::IMREAD_GRAYSCALE);
+        return (!source.empty());
+    }
+
+    bool empty () const { return (source.empty() && polygons.empty()); }
+
+    // Bounding box of the region in the image of the last apply().
+    cv::Rect bounds () const { return (box); }
+
+    // Crop of 'image' to bounds(), with the pixels outside the region set to the mean inside it.
+    // When the region fills its bounding box 'out' is only a header onto 'image'.
+    void apply (const cv::Mat& image, cv::Mat& out) {
+        if (mask.empty() || imageSize != image.size()) build (image.size());
+        if (full) {
+            out = image (box);
+            return;
+        }
+        image (box).copyTo (out);
+        out.setTo (cv::mean (out, mask), outside);
+    }
+
+private:
+    cv::Mat source;
+    std::vector< std::vector<cv::Point> > polygons;
+    cv::Size imageSize;
+    cv::Rect box;
+    cv::Mat mask, outside;   // region and its complement, within box
+    bool full;
+
+    void build (cv::Size size) {
+        imageSize = size;
+        cv::Mat fullMask;
+        if (!polygons.empty()) {
+            fullMask = cv::Mat::zeros (size, CV_8UC1);
+            cv::fillPoly (fullMask, polygons, cv::Scalar::all(255));
+        }
+        else if (source.size() != size)
+            cv::resize (source, fullMask, size, 0, 0, cv::INTER_NEAREST);
+        else
+            fullMask = source;
+
+        std::vector<cv::Point> inside;
+        cv::findNonZero (fullMask, inside);
+        if (inside.empty()) box = cv::Rect (0, 0, size.width, size.height);   // empty mask: no restriction
+        else box = cv::boundingRect (inside);
+        cv::compare (fullMask (box), 0, mask, cv::CMP_NE);
+        cv::compare (fullMask (box), 0, outside, cv::CMP_EQ);
+        full = cv::countNonZero (outside) == 0 || cv::countNonZero (mask) == 0;
+    }
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define STRING_UTILS_HPP__
 
 #include <string>
+#include <vector>
+#include <cstdlib>
 #include <unordered_map>
 
 
@@ -16,6 +18,26 @@ std::string multi_replace (std::string str, std::unordered_map<std::string,std::
      return (str);
 }
 
+// Parses a list of ids such as "0-29,40,42" (no space) into the individual ids.
+std::vector<int> parse_id_list (std::string idstring) {
+    std::vector<int> ret;
+    size_t len, nxtpos=0, lastpos=0;
+    while (nxtpos!=std::string::npos && lastpos<idstring.length()) {
+        nxtpos = idstring.find (',', lastpos);
+        if (nxtpos==std::string::npos) len = idstring.length() - lastpos;
+        else len = nxtpos - lastpos;
+        std::string item = idstring.substr (lastpos, len);
+        size_t dash = item.find ('-', 1);
+        if (dash==std::string::npos)
+            ret.push_back (atoi (item.c_str()));
+        else
+            for (int id=atoi(item.substr(0,dash).c_str()); id<=atoi(item.substr(dash+1).c_str()); ++id)
+                ret.push_back (id);
+        lastpos = nxtpos + 1;
+    }
+    return (ret);
+}
+
 /*unordered_map<string,string> mocap_fname_replacements = { {"[ci]", to_string(camId)} };
 
 #define mocap_parse_fname(fname)  multi_replace((fname),mocap_fname_replacements)*/
@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_HPP__
+#define THREAD_POOL_HPP__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Fixed set of worker threads for data-parallel loops. parallel_for(n, func) calls func(i)
+ * for i = 0..n-1 spread over the workers and the calling thread, and returns when all
+ * calls are done. The threads are kept between loops, so it can be used per batch.
+ */
+class ThreadPool {
+public:
+    // nThreads <= 0: one thread per hardware core
+    ThreadPool (int nThreads=0) : generation(0), n(0), nBusy(0), stopping(false) {
+        if (nThreads <= 0) nThreads = std::max (1, (int)std::thread::hardware_concurrency());
+        for (int a=1; a<nThreads; ++a)  // the calling thread is the last worker
+            workers.push_back (std::thread (&ThreadPool::worker_loop, this));
+    }
+
+    ~ThreadPool () {
+        {
+            std::lock_guard<std::mutex> lock (mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (int a=0; a<workers.size(); ++a)
+            workers[a].join();
+    }
+
+    int size () const { return ((int)workers.size() + 1); }
+
+    void parallel_for (int count, const std::function<void(int)>& func) {
+        {
+            std::lock_guard<std::mutex> lock (mtx);
+            job = func;
+            n = count;
+            next = 0;
+            nBusy = (int)workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        run_job();
+        std::unique_lock<std::mutex> lock (mtx);
+        done.wait (lock, [this]{ return (nBusy == 0); });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::function<void(int)> job;
+    std::mutex mtx;
+    std::condition_variable wake, done;
+    long generation;
+    int n, nBusy;
+    std::atomic<int> next;
+    bool stopping;
+
+    void run_job () {
+        for (int i = next++; i < n; i = next++)
+            job (i);
+    }
+
+    void worker_loop () {
+        long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock (mtx);
+                wake.wait (lock, [&]{ return (stopping || generation != seen); });
+                if (stopping) return;
+                seen = generation;
+            }
+            run_job();
+            std::lock_guard<std::mutex> lock (mtx);
+            if (--nBusy == 0) done.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef TRIANGULATION_HPP__
+#define TRIANGULATION_HPP__
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "cv_data_utils.hpp"
+
+/**
+ * Fuses the corners of markers seen by several calibrated cameras at (nearly) the same time.
+ * Corners are undistorted with each camera's intrinsics, triangulated in ground coordinates
+ * (linear DLT over all views, using the inverse of each camera's transformationMatrix), and a
+ * square of the marker's side is fitted to the four 3d corners to get the marker pose.
+ * Depth then comes from the baseline between cameras rather than from the apparent size of
+ * the marker in one view.
+ */
+class MultiViewTriangulator {
+public:
+    struct Marker {
+        int id, nViews;
+        unsigned int cameras;    // bit c set if camera c (0..31) was one of the views
+        cv::Vec3d position;      // marker centre, ground coordinates
+        cv::Vec3d headvec;       // marker x axis, ground coordinates
+        double rmsError;         // RMS distance of the triangulated corners from the fitted square
+        double timestamp;        // capture time of the newest view
+    };
+
+    MultiViewTriangulator () : markerLength(0.1f) { }
+    MultiViewTriangulator (float markerSideLength) : markerLength(markerSideLength) { }
+
+    // cameraToGround: the 3x4 (or 4x4 homogeneous) transformationMatrix of the camera.
+    void set_camera (int camId, const cv::Mat& camMatrix, const cv::Mat& distCoeffs, const cv::Mat& cameraToGround) {
+        Camera& cam = cameras[camId];
+        camMatrix.copyTo (cam.camMatrix);
+        distCoeffs.copyTo (cam.distCoeffs);
+        cv::Matx44d T = cv::Matx44d::eye();
+        for (int a=0; a<3; ++a)
+            for (int b=0; b<4; ++b)
+                T(a,b) = cameraToGround.at<double>(a,b);
+        cv::Matx44d Tinv = T.inv();
+        for (int a=0; a<3; ++a)
+            for (int b=0; b<4; ++b)
+                cam.groundToCamera(a,b) = Tinv(a,b);
+    }
+
+    void clear () {
+        for (auto it=observations.begin(); it!=observations.end(); ++it)
+            it->second.clear();
+    }
+
+    // Adds the corners of marker 'id' seen by camera 'camId' at 'timestamp'.
+    void add_observation (int camId, int id, const std::vector<cv::Point2f>& corners, double timestamp) {
+        if (cameras.find (camId) == cameras.end()) return;
+        Observation obs;
+        obs.camId = camId;
+        obs.timestamp = timestamp;
+        cv::undistortPoints (corners, obs.normCorners, cameras[camId].camMatrix, cameras[camId].distCoeffs);
+        observations[id].push_back (obs);
+    }
+
+    // Triangulates every marker seen by at least two cameras within maxSkew seconds of its newest view.
+    void triangulate (std::vector<Marker>& markers, double maxSkew) {
+        markers.clear();
+        for (auto it=observations.begin(); it!=observations.end(); ++it) {
+            std::vector<Observation>& obs = it->second;
+            if (obs.size() < 2) continue;
+            double newest = obs[0].timestamp;
+            for (int v=1; v<obs.size(); ++v) newest = std::max (newest, obs[v].timestamp);
+            views.clear();
+            for (int v=0; v<obs.size(); ++v)
+                if (newest - obs[v].timestamp <= maxSkew) views.push_back (&obs[v]);
+            if (views.size() < 2) continue;
+
+            std::vector<cv::Vec3d> corners3d (4), model (4);
+            for (int j=0; j<4; ++j)
+                corners3d[j] = triangulate_point (j);
+
+            // marker model: corners in aruco order around the origin, x to the right, y up
+            double half = markerLength / 2.0;
+            model[0] = cv::Vec3d (-half, half, 0); model[1] = cv::Vec3d (half, half, 0);
+            model[2] = cv::Vec3d (half, -half, 0); model[3] = cv::Vec3d (-half, -half, 0);
+            cv::Matx34d T = similarity_transform_3d (model, corners3d, false);   // known side: no scale
+
+            Marker m;
+            m.id = it->first;
+            m.nViews = (int)views.size();
+            m.timestamp = newest;
+            m.cameras = 0;
+            for (int v=0; v<views.size(); ++v)
+                if (views[v]->camId >= 0 && views[v]->camId < 32) m.cameras |= 1u << views[v]->camId;
+            m.position = cv::Vec3d (T(0,3), T(1,3), T(2,3));
+            m.headvec = cv::Vec3d (T(0,0), T(1,0), T(2,0));
+            m.headvec *= 1.0 / cv::norm (m.headvec);
+            double sqErr = 0.0;
+            for (int j=0; j<4; ++j) {
+                cv::Vec3d d = transform_point (T, model[j]) - corners3d[j];
+                sqErr += d.dot(d);
+            }
+            m.rmsError = std::sqrt (sqErr / 4.0);
+            markers.push_back (m);
+        }
+    }
+
+private:
+    struct Camera {
+        cv::Mat camMatrix, distCoeffs;
+        cv::Matx34d groundToCamera;
+    };
+    struct Observation {
+        int camId;
+        double timestamp;
+        std::vector<cv::Point2f> normCorners;   // undistorted, normalized image coordinates
+    };
+
+    float markerLength;
+    std::unordered_map<int,Camera> cameras;
+    std::unordered_map<int, std::vector<Observation> > observations;   // by marker id
+    std::vector<Observation*> views;
+    cv::Mat A, X;
+
+    // DLT: each view gives x*P3 - P1 = 0 and y*P3 - P2 = 0 for the homogeneous ground point.
+    cv::Vec3d triangulate_point (int corner) {
+        A.create ((int)views.size()*2, 4, CV_64F);
+        for (int v=0; v<views.size(); ++v) {
+            const cv::Matx34d& P = cameras[views[v]->camId].groundToCamera;
+            cv::Point2f p = views[v]->normCorners[corner];
+            for (int c=0; c<4; ++c) {
+                A.at<double>(2*v, c) = p.x * P(2,c) - P(0,c);
+                A.at<double>(2*v+1, c) = p.y * P(2,c) - P(1,c);
+            }
+        }
+        cv::SVD::solveZ (A, X);
+        double w = X.at<double>(3);
+        return (cv::Vec3d (X.at<double>(0)/w, X.at<double>(1)/w, X.at<double>(2)/w));
+    }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef VECTOR_DRAWING_HPP__
+#define VECTOR_DRAWING_HPP__
+
+#include <opencv2/core.hpp>
+#include <opencv2/aruco.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "pdf_writer.hpp"
+
+/**
+ * Markers and boards drawn as black rectangles on a page sized in millimetres, written as
+ * SVG or PDF. Nothing is rasterized, so the output is small and exact at any print size.
+ * All black cells of a page go into a single filled path, which keeps renderers from showing
+ * seams between neighbouring cells.
+ */
+struct VectorText {
+    cv::Point2d origin;   // left end of the baseline, mm from the top left corner of the page
+    double size;          // font size, mm
+    std::string text;
+};
+
+struct VectorPage {
+    double width, height;             // mm
+    std::vector<cv::Rect2d> black;    // mm from the top left corner of the page
+    std::vector<VectorText> texts;
+
+    VectorPage () : width(0), height(0) { }
+    VectorPage (double w, double h) : width(w), height(h) { }
+};
+
+// Draws marker 'id' (including its black border of borderBits cells) with its top left corner at
+// 'topLeft' and side length 'side'. Black cells of a row are merged into one rectangle.
+void draw_marker_vector (const cv::aruco::Dictionary& dictionary, int id, int borderBits,
+                         cv::Point2d topLeft, double side, VectorPage& page) {
+    cv::Mat bits = cv::aruco::Dictionary::getBitsFromByteList (dictionary.bytesList.rowRange (id, id+1), dictionary.markerSize);
+    int cells = dictionary.markerSize + 2*borderBits;
+    double cell = side / cells;
+    for (int r=0; r<cells; ++r) {
+        int runStart = -1;
+        for (int c=0; c<=cells; ++c) {
+            bool black = false;
+            if (c < cells) {
+                bool border = r < borderBits || r >= cells-borderBits || c < borderBits || c >= cells-borderBits;
+                black = border || bits.at<unsigned char>(r-borderBits, c-borderBits) == 0;
+            }
+            if (black && runStart < 0) runStart = c;
+            if (!black && runStart >= 0) {
+                page.black.push_back (cv::Rect2d (topLeft.x + runStart*cell, topLeft.y + r*cell, (c-runStart)*cell, cell));
+                runStart = -1;
+            }
+        }
+    }
+}
+
+// Draws all markers of a board whose marker corners span boardSize (board coordinates, y up,
+// origin at the bottom left) onto a page with 'margin' around it. If squareLength > 0 the board
+// is a ChArUco board: every chessboard square that does not hold a marker is black.
+void draw_board_vector (const cv::aruco::Board& board, cv::Size2d boardSize, double margin, int borderBits,
+                        double squareLength, VectorPage& page) {
+    page = VectorPage (boardSize.width + 2*margin, boardSize.height + 2*margin);
+    int squaresX = 0, squaresY = 0;
+    std::vector<bool> hasMarker;
+    if (squareLength > 0) {
+        squaresX = (int)std::floor (boardSize.width / squareLength + 0.5);
+        squaresY = (int)std::floor (boardSize.height / squareLength + 0.5);
+        hasMarker.assign (squaresX*squaresY, false);
+    }
+    for (int i=0; i<board.ids.size(); ++i) {
+        const cv::Point3f& tl = board.objPoints[i][0];
+        double side = board.objPoints[i][1].x - tl.x;
+        cv::Point2d pos (tl.x, boardSize.height - tl.y);
+        draw_marker_vector (board.dictionary, board.ids[i], borderBits, pos + cv::Point2d (margin, margin), side, page);
+        if (squareLength > 0) {
+            int col = (int)((pos.x + side/2) / squareLength), row = (int)((pos.y + side/2) / squareLength);
+            if (col >= 0 && col < squaresX && row >= 0 && row < squaresY) hasMarker[row*squaresX + col] = true;
+        }
+    }
+    for (int row=0; row<squaresY; ++row)
+        for (int col=0; col<squaresX; ++col)
+            if (!hasMarker[row*squaresX + col])
+                page.black.push_back (cv::Rect2d (margin + col*squareLength, margin + row*squareLength, squareLength, squareLength));
+}
+
+// ================================================
+
+bool write_svg (const std::string& filename, const VectorPage& page) {
+    std::ofstream file (filename.c_str());
+    if (!file.is_open()) return (false);
+    file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << page.width << "mm\" height=\"" << page.height << "mm\""
+         << " viewBox=\"0 0 " << page.width << " " << page.height << "\">\n"
+         << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n<path fill=\"black\" d=\"";
+    for (int a=0; a<page.black.size(); ++a) {
+        const cv::Rect2d& r = page.black[a];
+        file << "M" << r.x << " " << r.y << "h" << r.width << "v" << r.height << "h" << -r.width << "z";
+    }
+    file << "\"/>\n";
+    for (int a=0; a<page.texts.size(); ++a)
+        file << "<text x=\"" << page.texts[a].origin.x << "\" y=\"" << page.texts[a].origin.y << "\" font-family=\"Helvetica, Arial, sans-serif\""
+             << " font-size=\"" << page.texts[a].size << "\">" << page.texts[a].text << "</text>\n";
+    file << "</svg>\n";
+    return (file.good());
+}
+
+void add_pdf_page (PdfWriter& pdf, const VectorPage& page) {
+    const double pt = 72.0 / 25.4;
+    std::ostringstream content;
+    content << "0 g\n";
+    for (int a=0; a<page.black.size(); ++a) {
+        const cv::Rect2d& r = page.black[a];
+        content << r.x*pt << " " << (page.height - r.y - r.height)*pt << " " << r.width*pt << " " << r.height*pt << " re\n";
+    }
+    if (!page.black.empty()) content << "f\n";
+    for (int a=0; a<page.texts.size(); ++a)
+        content << "BT /F1 " << page.texts[a].size*pt << " Tf " << page.texts[a].origin.x*pt << " "
+                << (page.height - page.texts[a].origin.y)*pt << " Td (" << page.texts[a].text << ") Tj ET\n";
+    pdf.add_page (page.width*pt, page.height*pt, content.str());
+}
+
+// True if the file name asks for vector output (.svg or .pdf).
+bool is_vector_file (const std::string& filename) {
+    size_t dot = filename.rfind ('.');
+    if (dot == std::string::npos) return (false);
+    std::string ext = filename.substr (dot+1);
+    return (ext == "svg" || ext == "SVG" || ext == "pdf" || ext == "PDF");
+}
+
+bool write_vector_page (const std::string& filename, const VectorPage& page) {
+    size_t dot = filename.rfind ('.');
+    if (dot != std::string::npos && (filename.substr (dot+1) == "svg" || filename.substr (dot+1) == "SVG"))
+        return (write_svg (filename, page));
+    PdfWriter pdf;
+    if (!pdf.open (filename)) return (false);
+    add_pdf_page (pdf, page);
+    return (pdf.close());
+}
+
+#endif
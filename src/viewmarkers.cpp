@@ -39,10 +39,16 @@ the use of this software, even if advised of the possibility of such damage.
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/aruco.hpp>
+#include <opencv2/imgproc.hpp>
 #include <iostream>
+#include <cstdio>
 #include <unordered_map>
 
 #include "utils/string_utils.hpp"
+#include "utils/marker_detector.hpp"
+#include "utils/frame_pool.hpp"
+#include "utils/alloc_counter.hpp"
+#include "utils/roi_mask.hpp"
 
 using namespace std;
 using namespace cv;
@@ -59,9 +65,84 @@ const char* keys  =
         "{c        |       | Camera intrinsic parameters. Needed for camera pose }"
         "{l        | 0.1   | Marker side lenght (in meters). Needed for correct scale in camera pose }"
         "{dp       |       | File of marker detector parameters }"
+        "{ids      |       | Allowed marker ids, e.g. '0-29,40' (no space). If given, only these ids are decoded. }"
+        "{fd       | false | Use the built-in single-pass marker detector (implied by -ids and -diag) }"
+        "{diag     | false | Show the candidate funnel and time per detection phase (per frame and over 30 frames), and a heatmap of where rejected candidates come from. Uses the built-in detector }"
+        "{mask     |       | Detection mask file: image (non-zero pixels are searched) or .yml with a list of polygons. [ci] will be replaced by camera id. }"
         "{r        |       | show rejected candidates too }";
 }
 
+/**
+ * Candidate funnel and phase times of the built-in detector over the last frames, and a
+ * slowly fading heatmap of the centres of rejected candidates.
+ */
+class DetectionDiagnostics {
+public:
+    DetectionDiagnostics () { reset(); }
+
+    void add (const MarkerDetector::Stats& s, const vector< vector< Point2f > >& rejected, Size imageSize) {
+        sum.contours += s.contours; sum.candidates += s.candidates;
+        sum.rejected += s.rejected; sum.accepted += s.accepted;
+        sum.thresholdMs += s.thresholdMs; sum.contoursMs += s.contoursMs;
+        sum.decodeMs += s.decodeMs; sum.refineMs += s.refineMs;
+        ++nFrames;
+
+        if (heat.empty())
+            heat = Mat::zeros ((imageSize.height + cellSize - 1) / cellSize, (imageSize.width + cellSize - 1) / cellSize, CV_32F);
+        heat *= 0.98;
+        for (int a=0; a<rejected.size(); ++a) {
+            Point2f c = (rejected[a][0] + rejected[a][1] + rejected[a][2] + rejected[a][3]) * 0.25f;
+            int x = min (heat.cols-1, max (0, (int)c.x / cellSize)), y = min (heat.rows-1, max (0, (int)c.y / cellSize));
+            heat.at<float>(y, x) += 1.f;
+        }
+    }
+
+    static void print (const MarkerDetector::Stats& s, const string& label, double n) {
+        cout << label << ": contours " << s.contours / n << ", candidates " << s.candidates / n << ", rejected " << s.rejected / n
+             << ", markers " << s.accepted / n << ". Threshold " << s.thresholdMs / n << " ms, contours " << s.contoursMs / n
+             << " ms, decode " << s.decodeMs / n << " ms, refine " << s.refineMs / n << " ms" << endl;
+    }
+
+    // Prints the means since the last call and starts over.
+    void print_rolling () {
+        if (nFrames > 0) print (sum, "Mean of " + to_string (nFrames) + " frames", nFrames);
+        reset();
+    }
+
+    static void draw_frame_stats (Mat& image, const MarkerDetector::Stats& s) {
+        char line[160];
+        snprintf (line, sizeof(line), "contours %d  candidates %d  rejected %d  markers %d",
+                  s.contours, s.candidates, s.rejected, s.accepted);
+        putText (image, line, Point (10, 20), FONT_HERSHEY_SIMPLEX, 0.5, Scalar (0, 255, 255), 1);
+        snprintf (line, sizeof(line), "threshold %.1f ms  contours %.1f ms  decode %.1f ms  refine %.1f ms",
+                  s.thresholdMs, s.contoursMs, s.decodeMs, s.refineMs);
+        putText (image, line, Point (10, 40), FONT_HERSHEY_SIMPLEX, 0.5, Scalar (0, 255, 255), 1);
+    }
+
+    // Heatmap of rejects (blue: none, red: most) blended over the image.
+    void draw_heatmap (const Mat& image, Mat& out) {
+        double maxHeat = 0.0;
+        minMaxLoc (heat, 0, &maxHeat);
+        heat.convertTo (heat8, CV_8U, maxHeat > 0.0 ? 255.0 / maxHeat : 0.0);
+        resize (heat8, heatBig, image.size(), 0, 0, INTER_NEAREST);
+        applyColorMap (heatBig, heatColor, COLORMAP_JET);
+        addWeighted (image, 0.5, heatColor, 0.5, 0.0, out);
+    }
+
+private:
+    static const int cellSize = 16;
+    MarkerDetector::Stats sum;
+    int nFrames;
+    Mat heat, heat8, heatBig, heatColor;
+
+    void reset () {
+        sum = MarkerDetector::Stats();
+        sum.contours = sum.candidates = sum.rejected = sum.accepted = 0;
+        sum.thresholdMs = sum.contoursMs = sum.decodeMs = sum.refineMs = 0.0;
+        nFrames = 0;
+    }
+};
+
 /**
  */
 static bool readCameraParameters(string filename, Mat &camMatrix, Mat &distCoeffs) {
@@ -148,6 +229,18 @@ int main(int argc, char *argv[]) {
     aruco::Dictionary dictionary =
         aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
 
+    bool diagnostics = parser.get<bool>("diag");
+    bool useMarkerDetector = parser.has("ids") || parser.get<bool>("fd") || diagnostics;
+    MarkerDetector markerDetector;
+    if (useMarkerDetector)
+        markerDetector = MarkerDetector (dictionary, detectorParams, parse_id_list (parser.get<string>("ids")));
+
+    RoiMask roiMask;
+    if(parser.has("mask") && !roiMask.load (multi_replace(parser.get<string>("mask"),fname_replacements))) {
+        cerr << "Invalid mask file" << endl;
+        return 0;
+    }
+
     Mat camMatrix, distCoeffs;
     if(estimatePose) {
         bool readOk = readCameraParameters (multi_replace(parser.get<string>("c"),fname_replacements), camMatrix, distCoeffs);
@@ -169,29 +262,57 @@ int main(int argc, char *argv[]) {
 
     double totalTime = 0;
     int totalIterations = 0;
+    FramePool framePool;
+    DetectionDiagnostics diag;
+    Mat heatmapImage;
 
     while(inputVideo.grab()) {
-        Mat image, imageCopy;
+        // frame buffers and detection results are recycled from frame to frame
+        FrameSlot& frame = framePool.acquire();
+        Mat& image = frame.image;
+        Mat& imageCopy = frame.preview;
+        long allocsBefore = allocation_count();
         inputVideo.retrieve(image);
 
         double tick = (double)getTickCount();
 
-        vector< int > ids;
-        vector< vector< Point2f > > corners, rejected;
-        vector< Vec3d > rvecs, tvecs;
-
-        // detect markers and estimate pose
-        aruco::detectMarkers(image, dictionary, corners, ids, detectorParams, rejected);
+        vector< int >& ids = frame.det.ids;
+        vector< vector< Point2f > >& corners = frame.det.corners;
+        vector< vector< Point2f > >& rejected = frame.det.rejected;
+        vector< Vec3d >& rvecs = frame.det.rvecs;
+        vector< Vec3d >& tvecs = frame.det.tvecs;
+
+        // detect markers (in the masked crop of the image, with -mask) and estimate pose
+        Mat detectImage = image;
+        if(!roiMask.empty()) {
+            roiMask.apply(image, frame.masked);
+            detectImage = frame.masked;
+        }
+        if (useMarkerDetector)
+            markerDetector.detect(detectImage, frame.det);
+        else
+            aruco::detectMarkers(detectImage, dictionary, corners, ids, detectorParams, rejected);
+        if(!roiMask.empty()) {
+            corners_to_image(corners, roiMask.bounds(), 1.0);
+            corners_to_image(rejected, roiMask.bounds(), 1.0);
+        }
         if(estimatePose && ids.size() > 0)
             aruco::estimatePoseSingleMarkers(corners, markerLength, camMatrix, distCoeffs, rvecs,
                                              tvecs);
 
         double currentTime = ((double)getTickCount() - tick) / getTickFrequency();
+        long frameAllocs = allocation_count() - allocsBefore;
         totalTime += currentTime;
         totalIterations++;
+        if(diagnostics)
+            diag.add(markerDetector.stats, rejected, image.size());
         if(totalIterations % 30 == 0) {
             cout << "Detection Time = " << currentTime * 1000 << " ms "
-                 << "(Mean = " << 1000 * totalTime / double(totalIterations) << " ms)" << endl;
+                 << "(Mean = " << 1000 * totalTime / double(totalIterations) << " ms)";
+            if (allocation_counting())
+                cout << ". Heap allocations in capture+detection: " << frameAllocs;
+            cout << endl;
+            if(diagnostics) diag.print_rolling();
         }
 
         // draw results
@@ -209,7 +330,14 @@ int main(int argc, char *argv[]) {
         if(showRejected && rejected.size() > 0)
             aruco::drawDetectedMarkers(imageCopy, rejected, noArray(), Scalar(100, 0, 255));
 
+        if(diagnostics) {
+            diag.draw_heatmap(image, heatmapImage);
+            imshow("rejects", heatmapImage);
+            DetectionDiagnostics::draw_frame_stats(imageCopy, markerDetector.stats);
+        }
+
         imshow("out", imageCopy);
+        framePool.release(frame);
         char key = (char)waitKey(waitTime);
         if(key == 27) break;
     }